@@ -0,0 +1,101 @@
+/******************************************************************************
+ *  Benchmark of addBuoyancy() against a copy of the same memory traffic.
+ *
+ *  Build from the top of the repository:
+ *
+ *      g++ -std=c++11 -O2 -Iplatec_src bench/buoyancy.cpp \
+ *          platec_src/buoyancy.cpp platec_src/simd.cpp \
+ *          platec_src/utils.cpp -o buoyancy-bench
+ *
+ *  and run each kernel with PLATEC_SIMD capping the instruction set:
+ *
+ *      for k in scalar sse41 avx2 avx512; do
+ *          PLATEC_SIMD=$k ./buoyancy-bench
+ *      done
+ *
+ *  An optional argument gives the side of the square map (default 4096).
+ *  Each point reads 8 bytes of age and reads and writes 4 bytes of height;
+ *  the reference copies 8 bytes per point, which moves as many bytes.
+ *****************************************************************************/
+
+#include "buoyancy.hpp"
+#include "simd.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const int REPEATS = 10;
+
+static const char* levelName(Platec::SimdLevel level)
+{
+    switch (level)
+    {
+        case Platec::SIMD_SSE41:  return "sse41";
+        case Platec::SIMD_AVX2:   return "avx2";
+        case Platec::SIMD_AVX512: return "avx512";
+        default:                  return "scalar";
+    }
+}
+
+/// Return the shortest of REPEATS runs of f, in seconds.
+template <class F>
+static double bestOf(F f)
+{
+    double best = 0.0;
+    for (int r = 0; r < REPEATS; ++r)
+    {
+        const std::chrono::steady_clock::time_point t0 =
+            std::chrono::steady_clock::now();
+        f();
+        const double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+        if (r == 0 || s < best)
+            best = s;
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t side = argc > 1 ? (size_t)atol(argv[1]) : 4096;
+    const size_t area = side * side;
+    if (area == 0)
+    {
+        fprintf(stderr, "usage: %s [side]\n", argv[0]);
+        return 1;
+    }
+
+    // Heights around the continental base and ages on both sides of the
+    // bonus limit, so that every branch of the kernels is taken.
+    const size_t now = 1000, max_age = 20;
+    std::vector<float> hmap(area);
+    std::vector<size_t> amap(area);
+    srand(1);
+    for (size_t i = 0; i < area; ++i)
+    {
+        hmap[i] = (rand() % 200) / 100.0f;
+        amap[i] = now - rand() % (2 * max_age);
+    }
+
+    // Touch every page once before timing.
+    addBuoyancy(&hmap[0], &amap[0], area, now, max_age, 0.3f, 1.0f);
+    const double kernel = bestOf([&]() {
+        addBuoyancy(&hmap[0], &amap[0], area, now, max_age, 0.3f, 1.0f);
+    });
+
+    std::vector<char> src(area * sizeof(size_t), 1), dst(src.size());
+    memcpy(&dst[0], &src[0], src.size());
+    const double copy = bestOf([&]() {
+        memcpy(&dst[0], &src[0], src.size());
+    });
+
+    const double bytes = area * (sizeof(size_t) + 2 * sizeof(float));
+    printf("%ux%u %-6s  addBuoyancy %8.2f ms %6.2f GB/s"
+           "  memcpy %8.2f ms %6.2f GB/s\n",
+        (unsigned)side, (unsigned)side, levelName(Platec::simdLevel()),
+        kernel * 1e3, bytes / kernel / 1e9, copy * 1e3, bytes / copy / 1e9);
+    return 0;
+}
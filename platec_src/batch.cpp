@@ -0,0 +1,177 @@
+#include "batch.hpp"
+#include "lithosphere.hpp"
+
+#include <stdexcept>
+
+// Height, age and two plate index maps of the world, the initial noise map
+// and plates whose maps together cover about twice the world's area.
+static const size_t WORLD_BYTES_PER_PIXEL = sizeof(float) + 3 * sizeof(size_t) +
+    sizeof(float) + 2 * (sizeof(float) + 2 * sizeof(size_t));
+
+simulationBatch::simulationBatch(const std::vector<long>& seeds,
+    size_t width, size_t height, float sea_level,
+    size_t erosion_period, float folding_ratio,
+    size_t aggr_overlap_abs, float aggr_overlap_rel,
+    size_t cycle_count, size_t num_plates,
+    size_t num_threads, size_t memory_budget) :
+    _seeds(seeds),
+    _width(width), _height(height),
+    _sea_level(sea_level),
+    _erosion_period(erosion_period),
+    _folding_ratio(folding_ratio),
+    _aggr_overlap_abs(aggr_overlap_abs),
+    _aggr_overlap_rel(aggr_overlap_rel),
+    _cycle_count(cycle_count),
+    _num_plates(num_plates),
+    _memory_budget(memory_budget),
+    _world_memory(estimateMemory(width, height)),
+    _next_seed(0),
+    _finished(0),
+    _reserved(0),
+    _stop(false),
+    _current(0)
+{
+    if (num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0)
+        num_threads = 1;
+    if (num_threads > seeds.size())
+        num_threads = seeds.size();
+
+    for (size_t i = 0; i < num_threads; ++i)
+        _runners.push_back(std::thread(&simulationBatch::runnerMain, this));
+}
+
+simulationBatch::~simulationBatch() throw()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stop = true;
+    }
+    _memoryFreed.notify_all();
+
+    for (size_t i = 0; i < _runners.size(); ++i)
+        _runners[i].join();
+
+    for (size_t i = 0; i < _results.size(); ++i)
+        delete _results[i];
+    delete _current;
+}
+
+size_t simulationBatch::estimateMemory(size_t width, size_t height)
+{
+    return width * height * WORLD_BYTES_PER_PIXEL;
+}
+
+bool simulationBatch::next()
+{
+    std::unique_lock<std::mutex> guard(_lock);
+
+    if (_current)
+    {
+        _reserved -= _current->getMemory();
+        delete _current;
+        _current = 0;
+        _memoryFreed.notify_all();
+    }
+
+    while (_results.empty() && _finished < _seeds.size())
+        _resultReady.wait(guard);
+
+    if (_results.empty())
+        return false;
+
+    _current = _results.front();
+    _results.pop_front();
+
+    if (_current->error)
+        std::rethrow_exception(_current->error);
+
+    return true;
+}
+
+long simulationBatch::getSeed() const
+{
+    if (!_current)
+        throw std::logic_error("simulationBatch: no world has been read");
+    return _current->seed;
+}
+
+const float* simulationBatch::getTopography() const
+{
+    if (!_current)
+        throw std::logic_error("simulationBatch: no world has been read");
+    return &_current->topography[0];
+}
+
+const size_t* simulationBatch::getPlatesMap() const
+{
+    if (!_current)
+        throw std::logic_error("simulationBatch: no world has been read");
+    return &_current->plates[0];
+}
+
+void simulationBatch::simulate(result& r)
+{
+    lithosphere litho(r.seed, _width, _height, _sea_level,
+        _erosion_period, _folding_ratio, _aggr_overlap_abs,
+        _aggr_overlap_rel, _cycle_count);
+    litho.createPlates(_num_plates);
+
+    while (!litho.isFinished())
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (_stop)
+                return;
+        }
+        litho.update();
+    }
+
+    const size_t area = _width * _height;
+    r.topography.assign(litho.getTopography(), litho.getTopography() + area);
+    r.plates.assign(litho.getPlatesMap(), litho.getPlatesMap() + area);
+}
+
+void simulationBatch::runnerMain()
+{
+    for (;;)
+    {
+        result* r = 0;
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+
+            // Wait until this world fits in the budget. If nothing is
+            // running or waiting to be read, start it anyway.
+            while (!_stop && _next_seed < _seeds.size() &&
+                   _memory_budget > 0 && _reserved > 0 &&
+                   _reserved + _world_memory > _memory_budget)
+                _memoryFreed.wait(guard);
+
+            if (_stop || _next_seed >= _seeds.size())
+                return;
+
+            r = new result();
+            r->seed = _seeds[_next_seed++];
+            _reserved += _world_memory;
+        }
+
+        try {
+            simulate(*r);
+        } catch (...) {
+            r->error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+
+            // Only the finished maps stay in memory until they're read.
+            _reserved -= _world_memory;
+            _reserved += r->getMemory();
+            _results.push_back(r);
+            ++_finished;
+        }
+        _resultReady.notify_one();
+        _memoryFreed.notify_all();
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstring> // For size_t.
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs a set of independent simulations, one per seed, concurrently.
+ *
+ * Every world is simulated to the end on one of the batch's threads with
+ * the same parameters but its own seed. Finished worlds are handed out in
+ * the order they complete with next().
+ *
+ * The memory budget caps the estimated memory held by worlds that are being
+ * simulated or are waiting to be collected. A world is started only if its
+ * estimate fits in what's left of the budget, except that one world is
+ * always allowed to run so that large maps can't stall the batch.
+ */
+class simulationBatch
+{
+  public:
+
+	/**
+	 * Start simulating.
+	 *
+	 * @param seeds Seed of each world.
+	 * @param num_threads Number of worlds simulated at the same time.
+	 *                    Zero selects one per hardware thread.
+	 * @param memory_budget Max bytes used by the worlds; zero for no limit.
+	 *
+	 * The remaining parameters are those of lithosphere's constructor and
+	 * lithosphere::createPlates.
+	 */
+	simulationBatch(const std::vector<long>& seeds,
+		size_t width, size_t height, float sea_level,
+		size_t erosion_period, float folding_ratio,
+		size_t aggr_overlap_abs, float aggr_overlap_rel,
+		size_t cycle_count, size_t num_plates,
+		size_t num_threads, size_t memory_budget);
+
+	~simulationBatch() throw(); ///< Abort unfinished worlds and clean up.
+
+	/**
+	 * Wait for the next world to finish.
+	 *
+	 * The previous world's maps are released. If simulating the world
+	 * failed, its exception is rethrown here.
+	 *
+	 * @return False if all worlds have already been returned.
+	 */
+	bool next();
+
+	long getSeed() const;
+	const float* getTopography() const; ///< Height map of the world.
+	const size_t* getPlatesMap() const; ///< Plate index map of the world.
+	size_t getWidth() const throw() { return _width; }
+	size_t getHeight() const throw() { return _height; }
+
+	/// Rough upper limit of the memory used to simulate one world.
+	static size_t estimateMemory(size_t width, size_t height);
+
+  private:
+
+	class result
+	{
+	  public:
+		long seed;
+		std::vector<float> topography;
+		std::vector<size_t> plates;
+		std::exception_ptr error;
+
+		size_t getMemory() const
+		{
+			return topography.size() * sizeof(float) +
+			       plates.size() * sizeof(size_t);
+		}
+	};
+
+	simulationBatch(const simulationBatch&);
+	simulationBatch& operator=(const simulationBatch&);
+
+	void simulate(result& r);
+	void runnerMain();
+
+	const std::vector<long> _seeds;
+	const size_t _width, _height;
+	const float _sea_level;
+	const size_t _erosion_period;
+	const float _folding_ratio;
+	const size_t _aggr_overlap_abs;
+	const float _aggr_overlap_rel;
+	const size_t _cycle_count;
+	const size_t _num_plates;
+	const size_t _memory_budget;
+	const size_t _world_memory; ///< Estimated memory of one world.
+
+	std::vector<std::thread> _runners;
+	std::mutex _lock;
+	std::condition_variable _resultReady; ///< A world has finished.
+	std::condition_variable _memoryFreed; ///< Budget has been released.
+
+	size_t _next_seed;  ///< Index of the next world to start.
+	size_t _finished;   ///< Number of worlds that have finished.
+	size_t _reserved;   ///< Budget taken by running and unread worlds.
+	bool _stop;         ///< Abort simulations as soon as possible.
+	std::deque<result*> _results; ///< Finished worlds not yet read.
+	result* _current;   ///< World returned by the last call to next().
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "buoyancy.hpp"
+#include "simd.hpp"
+#include "utils.hpp"
+
+#ifdef PLATEC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace Platec;
+
+static void addBuoyancyScalar(float* hmap, const size_t* amap, size_t area,
+    size_t now, size_t max_age, float scale, float limit)
+{
+    const float mulinv_max_age = 1.0f / (float)max_age;
+
+    for (size_t i = 0; i < area; ++i)
+    {
+        // Calculate the inverted age of this piece of crust.
+        // Force result to be minimum between inv. age and
+        // max buoyancy bonus age.
+        size_t crust_age = now - amap[i];
+        crust_age = max_age - crust_age;
+        crust_age &= -(crust_age <= max_age);
+
+        hmap[i] += (hmap[i] < limit) * scale * crust_age * mulinv_max_age;
+    }
+}
+
+#ifdef PLATEC_SIMD_X86
+
+PLATEC_TARGET("sse4.1")
+static void addBuoyancySSE41(float* hmap, const size_t* amap, size_t area,
+    size_t now, size_t max_age, float scale, float limit)
+{
+    const __m128i vnow = _mm_set1_epi32((int)(uint32_t)now);
+    const __m128i vmax = _mm_set1_epi32((int)(uint32_t)max_age);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vinv = _mm_set1_ps(1.0f / (float)max_age);
+    const __m128 vlimit = _mm_set1_ps(limit);
+
+    size_t i = 0;
+    for (; i + 4 <= area; i += 4)
+    {
+        // Keep the low halves of four 64-bit timestamps.
+        const __m128 a01 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&amap[i]));
+        const __m128 a23 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&amap[i + 2]));
+        const __m128i age = _mm_castps_si128(_mm_shuffle_ps(a01, a23, _MM_SHUFFLE(2, 0, 2, 0)));
+
+        // Unsigned "d <= max_age" is "min(d, max_age) == d".
+        const __m128i d = _mm_sub_epi32(vnow, age);
+        const __m128i young = _mm_cmpeq_epi32(_mm_min_epu32(d, vmax), d);
+        const __m128i crust_age = _mm_and_si128(_mm_sub_epi32(vmax, d), young);
+
+        const __m128 h = _mm_loadu_ps(&hmap[i]);
+        const __m128 bonus = _mm_mul_ps(_mm_mul_ps(vscale, _mm_cvtepi32_ps(crust_age)), vinv);
+        const __m128 oceanic = _mm_cmplt_ps(h, vlimit);
+        _mm_storeu_ps(&hmap[i], _mm_add_ps(h, _mm_and_ps(bonus, oceanic)));
+    }
+
+    addBuoyancyScalar(hmap + i, amap + i, area - i, now, max_age, scale, limit);
+}
+
+PLATEC_TARGET("avx2")
+static void addBuoyancyAVX2(float* hmap, const size_t* amap, size_t area,
+    size_t now, size_t max_age, float scale, float limit)
+{
+    const __m256i vnow = _mm256_set1_epi32((int)(uint32_t)now);
+    const __m256i vmax = _mm256_set1_epi32((int)(uint32_t)max_age);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vinv = _mm256_set1_ps(1.0f / (float)max_age);
+    const __m256 vlimit = _mm256_set1_ps(limit);
+    const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    size_t i = 0;
+    for (; i + 8 <= area; i += 8)
+    {
+        // Pack the low halves of eight 64-bit timestamps.
+        const __m256i a0 = _mm256_permutevar8x32_epi32(
+            _mm256_loadu_si256((const __m256i*)&amap[i]), even);
+        const __m256i a1 = _mm256_permutevar8x32_epi32(
+            _mm256_loadu_si256((const __m256i*)&amap[i + 4]), even);
+        const __m256i age = _mm256_permute2x128_si256(a0, a1, 0x20);
+
+        const __m256i d = _mm256_sub_epi32(vnow, age);
+        const __m256i young = _mm256_cmpeq_epi32(_mm256_min_epu32(d, vmax), d);
+        const __m256i crust_age = _mm256_and_si256(_mm256_sub_epi32(vmax, d), young);
+
+        const __m256 h = _mm256_loadu_ps(&hmap[i]);
+        const __m256 bonus = _mm256_mul_ps(_mm256_mul_ps(vscale, _mm256_cvtepi32_ps(crust_age)), vinv);
+        const __m256 oceanic = _mm256_cmp_ps(h, vlimit, _CMP_LT_OQ);
+        _mm256_storeu_ps(&hmap[i], _mm256_add_ps(h, _mm256_and_ps(bonus, oceanic)));
+    }
+
+    addBuoyancyScalar(hmap + i, amap + i, area - i, now, max_age, scale, limit);
+}
+
+PLATEC_TARGET("avx512f")
+static void addBuoyancyAVX512(float* hmap, const size_t* amap, size_t area,
+    size_t now, size_t max_age, float scale, float limit)
+{
+    const __m512i vnow = _mm512_set1_epi32((int)(uint32_t)now);
+    const __m512i vmax = _mm512_set1_epi32((int)(uint32_t)max_age);
+    const __m512 vscale = _mm512_set1_ps(scale);
+    const __m512 vinv = _mm512_set1_ps(1.0f / (float)max_age);
+    const __m512 vlimit = _mm512_set1_ps(limit);
+    const __m512i low_halves = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14,
+        16, 18, 20, 22, 24, 26, 28, 30);
+
+    size_t i = 0;
+    for (; i + 16 <= area; i += 16)
+    {
+        // Truncate sixteen 64-bit timestamps into 32 bits by gathering the
+        // low halves of both loads. Unlike narrowing and inserting halves,
+        // this uses no intrinsic with an undefined pass-through operand,
+        // which GCC reports as maybe-uninitialized.
+        const __m512i age = _mm512_permutex2var_epi32(
+            _mm512_loadu_si512(&amap[i]), low_halves,
+            _mm512_loadu_si512(&amap[i + 8]));
+
+        const __m512i d = _mm512_sub_epi32(vnow, age);
+        const __mmask16 young = _mm512_cmple_epu32_mask(d, vmax);
+        const __m512i crust_age = _mm512_maskz_sub_epi32(young, vmax, d);
+
+        const __m512 h = _mm512_loadu_ps(&hmap[i]);
+        const __m512 bonus = _mm512_mul_ps(_mm512_mul_ps(vscale, _mm512_maskz_cvtepi32_ps(young, crust_age)), vinv);
+        const __mmask16 oceanic = _mm512_cmp_ps_mask(h, vlimit, _CMP_LT_OQ);
+        _mm512_storeu_ps(&hmap[i], _mm512_mask_add_ps(h, oceanic, h, bonus));
+    }
+
+    addBuoyancyScalar(hmap + i, amap + i, area - i, now, max_age, scale, limit);
+}
+
+#endif
+
+void addBuoyancy(float* hmap, const size_t* amap, size_t area, size_t now,
+                 size_t max_age, float scale, float limit)
+{
+#ifdef PLATEC_SIMD_X86
+    switch (simdLevel())
+    {
+        case SIMD_AVX512:
+            addBuoyancyAVX512(hmap, amap, area, now, max_age, scale, limit);
+            return;
+        case SIMD_AVX2:
+            addBuoyancyAVX2(hmap, amap, area, now, max_age, scale, limit);
+            return;
+        case SIMD_SSE41:
+            addBuoyancySSE41(hmap, amap, area, now, max_age, scale, limit);
+            return;
+        default:
+            break;
+    }
+#endif
+    addBuoyancyScalar(hmap, amap, area, now, max_age, scale, limit);
+}
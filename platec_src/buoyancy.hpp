@@ -0,0 +1,25 @@
+#ifndef BUOYANCY_HPP
+#define BUOYANCY_HPP
+
+#include <cstring> // For size_t.
+
+/**
+ * Add "virginity buoyancy" to the oceanic parts of a height map.
+ *
+ * Every point lower than 'limit' whose crust is at most 'max_age' iterations
+ * old is raised by scale * (max_age - age) / max_age. The vector kernels
+ * compute crust ages in 32 bits, which is exact as long as timestamps stay
+ * below 2^32; the result is identical to the scalar version.
+ *
+ * @param hmap Height map to modify.
+ * @param amap Timestamps of creation of each point of crust.
+ * @param area Number of points in both maps.
+ * @param now Current timestamp.
+ * @param max_age Age after which crust receives no bonus.
+ * @param scale Bonus height given to brand new crust.
+ * @param limit Height at and above which points receive no bonus.
+ */
+void addBuoyancy(float* hmap, const size_t* amap, size_t area, size_t now,
+                 size_t max_age, float scale, float limit);
+
+#endif
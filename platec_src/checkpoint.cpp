@@ -0,0 +1,182 @@
+#include "checkpoint.hpp"
+
+#include <cstring>
+
+namespace Checkpoint {
+
+static const size_t BUFFER_SIZE = 1 << 20; ///< Bytes gathered per write.
+static const size_t CONVERT_CHUNK = 4096; ///< Sizes widened at a time.
+
+typedef unsigned long long StoredSize;
+
+Writer::Writer(const std::string& path) :
+    _file(NULL), _path(path), _temporary(path + ".tmp"),
+    _buffer(new char[BUFFER_SIZE]), _used(0)
+{
+    _file = fopen(_temporary.c_str(), "wb");
+    if (!_file)
+    {
+        delete[] _buffer;
+        throw std::runtime_error("Cannot create checkpoint " + _temporary);
+    }
+    setvbuf(_file, NULL, _IONBF, 0);
+
+    write(MAGIC, sizeof(MAGIC));
+    putU32(VERSION);
+    putU32(BYTE_ORDER_MARK);
+}
+
+Writer::~Writer() throw()
+{
+    if (_file)
+    {
+        fclose(_file);
+        remove(_temporary.c_str());
+    }
+    delete[] _buffer;
+}
+
+void Writer::flush()
+{
+    if (_used > 0 && fwrite(_buffer, 1, _used, _file) != _used)
+        throw std::runtime_error("Cannot write checkpoint " + _temporary);
+    _used = 0;
+}
+
+void Writer::write(const void* data, size_t bytes)
+{
+    if (_used + bytes <= BUFFER_SIZE)
+    {
+        memcpy(_buffer + _used, data, bytes);
+        _used += bytes;
+        return;
+    }
+
+    flush();
+    if (bytes < BUFFER_SIZE)
+    {
+        memcpy(_buffer, data, bytes);
+        _used = bytes;
+    }
+    else if (fwrite(data, 1, bytes, _file) != bytes)
+        throw std::runtime_error("Cannot write checkpoint " + _temporary);
+}
+
+void Writer::putSize(size_t value)
+{
+    const StoredSize v = value;
+    write(&v, sizeof(v));
+}
+
+void Writer::putSizes(const size_t* values, size_t count)
+{
+    if (sizeof(size_t) == sizeof(StoredSize))
+    {
+        write(values, count * sizeof(size_t));
+        return;
+    }
+
+    StoredSize wide[CONVERT_CHUNK];
+    for (size_t i = 0; i < count; i += CONVERT_CHUNK)
+    {
+        const size_t n = count - i < CONVERT_CHUNK ? count - i : CONVERT_CHUNK;
+        for (size_t j = 0; j < n; ++j)
+            wide[j] = values[i + j];
+        write(wide, n * sizeof(StoredSize));
+    }
+}
+
+void Writer::commit()
+{
+    write(MAGIC, sizeof(MAGIC));
+    flush();
+
+    const bool written = fflush(_file) == 0 && !ferror(_file);
+    const bool closed = fclose(_file) == 0;
+    _file = NULL;
+    if (!written || !closed)
+    {
+        remove(_temporary.c_str());
+        throw std::runtime_error("Cannot write checkpoint " + _temporary);
+    }
+
+    // Windows doesn't rename over an existing file.
+    if (rename(_temporary.c_str(), _path.c_str()) != 0 &&
+        (remove(_path.c_str()) != 0 ||
+         rename(_temporary.c_str(), _path.c_str()) != 0))
+        throw std::runtime_error("Cannot replace checkpoint " + _path);
+}
+
+Reader::Reader(const std::string& path) : _file(NULL), _path(path)
+{
+    _file = fopen(path.c_str(), "rb");
+    if (!_file)
+        throw std::runtime_error("Cannot open checkpoint " + path);
+    setvbuf(_file, NULL, _IOFBF, BUFFER_SIZE);
+
+    try {
+        char magic[sizeof(MAGIC)];
+        read(magic, sizeof(magic));
+        if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+            throw std::runtime_error(path + " is not a checkpoint");
+        if (getU32() != VERSION)
+            throw std::runtime_error(path + " is a checkpoint of another version");
+        if (getU32() != BYTE_ORDER_MARK)
+            throw std::runtime_error(path + " is from a machine of another byte order");
+    } catch (...) {
+        fclose(_file);
+        throw;
+    }
+}
+
+Reader::~Reader() throw()
+{
+    fclose(_file);
+}
+
+void Reader::read(void* data, size_t bytes)
+{
+    if (fread(data, 1, bytes, _file) != bytes)
+        throw std::runtime_error("Checkpoint " + _path + " is truncated");
+}
+
+size_t Reader::getSize()
+{
+    StoredSize v;
+    read(&v, sizeof(v));
+    if (v != (size_t)v)
+        throw std::runtime_error("Checkpoint " + _path + " is too large");
+    return (size_t)v;
+}
+
+void Reader::getSizes(size_t* values, size_t count)
+{
+    if (sizeof(size_t) == sizeof(StoredSize))
+    {
+        read(values, count * sizeof(size_t));
+        return;
+    }
+
+    StoredSize wide[CONVERT_CHUNK];
+    for (size_t i = 0; i < count; i += CONVERT_CHUNK)
+    {
+        const size_t n = count - i < CONVERT_CHUNK ? count - i : CONVERT_CHUNK;
+        read(wide, n * sizeof(StoredSize));
+        for (size_t j = 0; j < n; ++j)
+        {
+            if (wide[j] != (size_t)wide[j])
+                throw std::runtime_error("Checkpoint " + _path + " is too large");
+            values[i + j] = (size_t)wide[j];
+        }
+    }
+}
+
+void Reader::finish()
+{
+    char magic[sizeof(MAGIC)];
+    read(magic, sizeof(magic));
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || fgetc(_file) != EOF)
+        throw std::runtime_error("Checkpoint " + _path + " is corrupt");
+}
+
+}
@@ -0,0 +1,99 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "utils.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Format of checkpoint files, see lithosphere::save.
+ *
+ * Files start with a magic string, the version and a byte order mark.
+ * Numbers are stored in the byte order of the machine that wrote them,
+ * sizes widened to 64 bits and floats as IEEE singles. A file ends with
+ * the magic string again to tell truncated files apart.
+ */
+namespace Checkpoint {
+
+static const char MAGIC[8] = { 'P', 'L', 'A', 'T', 'E', 'C', 'K', 'P' };
+static const uint32_t VERSION = 1;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/**
+ * Sequential writer of a checkpoint file.
+ *
+ * The file is written under a temporary name and only renamed to its
+ * final name by commit(), so that a crash while writing never destroys an
+ * earlier checkpoint. Small values are gathered into a large buffer and
+ * big arrays are written directly.
+ */
+class Writer
+{
+  public:
+	/// @exception runtime_error Thrown if the file can't be created.
+	explicit Writer(const std::string& path);
+	~Writer() throw(); ///< Discards the file unless it was committed.
+
+	void write(const void* data, size_t bytes);
+	void putU32(uint32_t value) { write(&value, sizeof(value)); }
+	void putSize(size_t value);
+	void putFloat(float value) { write(&value, sizeof(value)); }
+	void putFloats(const float* values, size_t count)
+	{
+		write(values, count * sizeof(float));
+	}
+	void putSizes(const size_t* values, size_t count);
+
+	/// Flush the file and move it to its final name.
+	/// @exception runtime_error Thrown if anything couldn't be written.
+	void commit();
+
+  private:
+	Writer(const Writer&);
+	Writer& operator=(const Writer&);
+
+	void flush();
+
+	FILE* _file;
+	std::string _path, _temporary;
+	char* _buffer;
+	size_t _used;
+};
+
+/// Sequential reader of a checkpoint file.
+class Reader
+{
+  public:
+	/// @exception runtime_error Thrown if the file can't be opened or
+	///            isn't a checkpoint of a supported version.
+	explicit Reader(const std::string& path);
+	~Reader() throw();
+
+	/// @exception runtime_error Thrown if the file ends too early.
+	void read(void* data, size_t bytes);
+	uint32_t getU32() { uint32_t v; read(&v, sizeof(v)); return v; }
+	size_t getSize();
+	float getFloat() { float v; read(&v, sizeof(v)); return v; }
+	void getFloats(float* values, size_t count)
+	{
+		read(values, count * sizeof(float));
+	}
+	void getSizes(size_t* values, size_t count);
+
+	/// Check the end marker and that nothing follows it.
+	/// @exception runtime_error Thrown if the file doesn't end there.
+	void finish();
+
+  private:
+	Reader(const Reader&);
+	Reader& operator=(const Reader&);
+
+	FILE* _file;
+	std::string _path;
+};
+
+}
+
+#endif
@@ -0,0 +1,13 @@
+#include "counterrandom.hpp"
+
+void CounterRandom::fill(float* values, size_t count) throw()
+{
+    // 24 bits is all a float in [0, 1[ can represent uniformly.
+    const float scale = 1.0f / 16777216.0f;
+    const uint64_t first = _key + (_counter + 1) * GOLDEN_GAMMA;
+
+    for (size_t i = 0; i < count; ++i)
+        values[i] = (uint32_t)(mix(first + i * GOLDEN_GAMMA) >> 40) * scale;
+
+    _counter += count;
+}
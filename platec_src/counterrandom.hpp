@@ -0,0 +1,56 @@
+#ifndef COUNTER_RANDOM_HPP
+#define COUNTER_RANDOM_HPP
+
+#include "utils.hpp"
+#include <cstddef>
+
+/**
+ * Counter-based pseudo-random number generator.
+ *
+ * The n-th number of a sequence is a hash of n and the sequence's key, so
+ * numbers can be generated in any order and on any thread and the results
+ * are still the same. The key is made from a seed and two more values that
+ * tell apart the sequences used for different purposes, e.g. a plate and a
+ * simulation step. The counter then selects e.g. a pixel.
+ *
+ * The hash is the output function of SplitMix64; a generator that's only
+ * advanced with next() produces the SplitMix64 sequence of its key.
+ */
+class CounterRandom
+{
+  public:
+	CounterRandom(uint32_t seed, uint32_t stream = 0, uint32_t substream = 0) :
+		_key(mix(mix(mix(seed) + stream) + substream)), _counter(0) {}
+
+	/// Number at the given position of the sequence.
+	uint32_t at(uint64_t counter) const throw()
+	{
+		return (uint32_t)(mix(_key + (counter + 1) * GOLDEN_GAMMA) >> 32);
+	}
+
+	uint32_t next() throw() { return at(_counter++); }
+	double next_double() throw() { return next() * (1.0 / 4294967296.0); } ///< In [0, 1[.
+	uint32_t maximum() const throw() { return 4294967295u; }
+
+	uint64_t getCounter() const throw() { return _counter; }
+	void setCounter(uint64_t counter) throw() { _counter = counter; }
+
+	/// Store the next count numbers scaled into [0, 1[.
+	void fill(float* values, size_t count) throw();
+
+	/// Finalizer of SplitMix64: every input bit affects every output bit.
+	static uint64_t mix(uint64_t z) throw()
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+  private:
+	static const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+
+	uint64_t _key;
+	uint64_t _counter; ///< Position of the next number.
+};
+
+#endif
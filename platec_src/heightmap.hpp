@@ -3,6 +3,7 @@
 
 #include <stdexcept> // std::invalid_argument
 #include <cstring>
+#include <memory>
 #include <string>
 #include "utils.hpp"
 
@@ -14,18 +15,19 @@ class Matrix
 public:
 
     Matrix(unsigned int width, unsigned int height)
-        : _width(width), _height(height)
+        : _width(width), _height(height), _capacity(width * height)
     {
         if (width == 0 || height == 0) {
             throw invalid_argument("width and height should be greater than zero");
         }
-        _data = new Value[width * height];
+        allocate(width * height);
     };
 
     Matrix( const Matrix<Value>& other )
-        : _width(other._width), _height(other._height)
+        : _width(other._width), _height(other._height),
+          _capacity(other._width * other._height)
     {
-        _data = new Value[_width * _height];
+        allocate(_width * _height);
         for (int x=0; x<_width;x++){
             for (int y=0; y<_height;y++){
                 set(x,y,other.get(x,y));
@@ -33,11 +35,6 @@ public:
         }
     }
 
-    ~Matrix()
-    {
-        delete[] _data;
-    }
-
     const void set_all(const Value& value)
     {
         // we cannot use memset to make it very general
@@ -69,10 +66,7 @@ public:
     {
         if (this != &other) // prevent self-assignment
         {
-            _width  = other._width;
-            _height = other._height;
-            delete[] _data;
-            _data = new Value[_width * _height];
+            resize(other._width, other._height);
             for (int x=0; x<_width; x++){
                 for (int y=0; y<_height; y++){
                     set(x, y, other.get(x,y));
@@ -82,6 +76,55 @@ public:
         return *this;
     }
 
+    /// Change the dimensions of the matrix. The buffer is only reallocated
+    /// if it's too small, and the contents are undefined afterwards.
+    void resize(unsigned int width, unsigned int height)
+    {
+        if (width == 0 || height == 0) {
+            throw invalid_argument("width and height should be greater than zero");
+        }
+        if (width * height > _capacity || _shared) {
+            allocate(width * height);
+        }
+        _width = width;
+        _height = height;
+    }
+
+    /// Make the matrix refer to the buffer of another one instead of a
+    /// copy. Neither may be modified before unshare() is called on it.
+    void share(const Matrix<Value>& other)
+    {
+        other._shared = true;
+        _shared = true;
+        _buffer = other._buffer;
+        _data = other._data;
+        _width = other._width;
+        _height = other._height;
+        _capacity = other._capacity;
+    }
+
+    /// Give the matrix a copy of its buffer if it has ever shared it. The
+    /// buffer is only read while shared, so the copies need no locking.
+    void unshare()
+    {
+        if (!_shared) {
+            return;
+        }
+        const shared_ptr<Value> old = _buffer;
+        allocate(_capacity);
+        memcpy(_data, old.get(), sizeof(Value) * _width * _height);
+    }
+
+    bool isShared() const
+    {
+        return _shared;
+    }
+
+    size_t capacity() const
+    {
+        return _capacity;
+    }
+
     Value& operator[](unsigned int index) const
     {
         if (index >= (_width*_height)) {
@@ -145,9 +188,20 @@ public:
 
 private:
 
+    void allocate(size_t capacity)
+    {
+        _buffer.reset(new Value[capacity], default_delete<Value[]>());
+        _data = _buffer.get();
+        _capacity = capacity;
+        _shared = false;
+    }
+
+    shared_ptr<Value> _buffer; ///< Owner of the data, see share().
+    mutable bool _shared; ///< Buffer may be used by another matrix.
     Value* _data;
     unsigned int _width;
     unsigned int _height;
+    unsigned int _capacity; ///< Number of values the buffer can hold.
 };
 
 typedef Matrix<float>  HeightMap;
@@ -21,7 +21,13 @@
 #include "sqrdmd.hpp"
 #include "simplexnoise.hpp"
 #include "noise.hpp"
+#include "buoyancy.hpp"
+#include "counterrandom.hpp"
+#include "checkpoint.hpp"
+#include "recorder.hpp"
+#include "stepper.hpp"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <cstdio>
@@ -54,11 +60,20 @@ static const float SUBDUCT_RATIO = 0.5f;
  
 static const float BUOYANCY_BONUS_X = 3;
 static const size_t MAX_BUOYANCY_AGE = 20;
-static const float MULINV_MAX_BUOYANCY_AGE = 1.0f / (float)MAX_BUOYANCY_AGE;
 
 static const float RESTART_ENERGY_RATIO = 0.15;
 static const float RESTART_SPEED_LIMIT = 2.0;
 static const size_t NO_COLLISION_TIME_LIMIT = 10;
+static const size_t SEA_LEVEL_BINS = 64; ///< Resolution of the sea level search.
+static const size_t SEA_LEVEL_BLOCK = 1 << 16; ///< Pixels per task.
+static const size_t GROWTH_TILE = 64; ///< Side of the tiles of plate growth.
+static const uint32_t GROWTH_UNREACHED = 0x7fffffff; ///< Cost of free pixels.
+static const size_t PLATE_BOUNDS_BLOCKS = 64; ///< Row blocks of the bounds pass.
+static const size_t MAX_PLATES = 1 << 16; ///< Collision records hold 16 bits.
+static const size_t MAX_MAP_AREA = 0xffffffff; ///< And 32 bits of location.
+static const uint32_t OPTION_PARALLEL_GROWTH = 1; ///< Checkpointed option bits.
+static const uint32_t OPTION_COALESCE_COLLISIONS = 2;
+static const uint32_t OPTION_CLASSIC_NOISE = 4;
 
 size_t findBound(const size_t* map, size_t length, size_t x0, size_t y0,
                  int dx, int dy);
@@ -66,15 +81,18 @@ size_t findPlate(plate** plates, float x, float y, size_t num_plates);
 
 void lithosphere::createNoise(float* tmp, const WorldDimension& tmpDim, bool useSimplex)
 {
-    ::createNoise(tmp, tmpDim, _randsource, useSimplex);
+    ::createNoise(tmp, tmpDim, _randsource, useSimplex, _threadPool,
+                  _noiseTolerance, _classicNoise);
 }
 
 lithosphere::lithosphere(long seed, size_t width, size_t height, float sea_level,
     size_t _erosion_period, float _folding_ratio, size_t aggr_ratio_abs,
-    float aggr_ratio_rel, size_t num_cycles) throw(invalid_argument) :
+    float aggr_ratio_rel, size_t num_cycles, size_t num_threads,
+    float noise_tolerance, bool parallel_growth, bool coalesce_collisions,
+    bool classic_noise)
+    throw(invalid_argument) :
     hmap(width, height),
     amap(width, height),
-    plates(0), 
     aggr_overlap_abs(aggr_ratio_abs),
     aggr_overlap_rel(aggr_ratio_rel), 
     cycle_count(0),
@@ -86,8 +104,21 @@ lithosphere::lithosphere(long seed, size_t width, size_t height, float sea_level
     num_plates(0),
     _worldDimension(width, height),
     _randsource(seed),
-    _steps(0)
+    _steps(0),
+    _threadPool(num_threads > 0 ? new Platec::ThreadPool(num_threads) :
+                                  &Platec::ThreadPool::shared()),
+    _ownsThreadPool(num_threads > 0),
+    _noiseTolerance(noise_tolerance),
+    _parallelGrowth(parallel_growth),
+    _coalesceCollisions(coalesce_collisions),
+    _classicNoise(classic_noise),
+    _recorder(0),
+    _stepper(0),
+    _publishing(false)
 {
+    if (_worldDimension.getArea() > MAX_MAP_AREA)
+        throw invalid_argument("map is too large");
+
     WorldDimension tmpDim = WorldDimension(width+1, height+1);
     const size_t A = tmpDim.getArea();
     float* tmp = new float[A];
@@ -95,15 +126,62 @@ lithosphere::lithosphere(long seed, size_t width, size_t height, float sea_level
 
     createNoise(tmp, tmpDim, true);
 
-    float lowest = tmp[0], highest = tmp[0];
-    for (size_t i = 1; i < A; ++i)
+    // The map is swept in blocks on the thread pool. Every block stores its
+    // own partial result, which are merged in order afterwards.
+    const size_t blocks = (A + SEA_LEVEL_BLOCK - 1) / SEA_LEVEL_BLOCK;
+    std::vector<float> block_lowest(blocks), block_highest(blocks);
+    _threadPool->parallelFor(0, blocks, [&](size_t first, size_t last)
     {
-        lowest = lowest < tmp[i] ? lowest : tmp[i];
-        highest = highest > tmp[i] ? highest : tmp[i];
+        for (size_t b = first; b < last; ++b)
+        {
+            const size_t end = std::min(A, (b + 1) * SEA_LEVEL_BLOCK);
+            float lo = tmp[b * SEA_LEVEL_BLOCK], hi = lo;
+            for (size_t i = b * SEA_LEVEL_BLOCK + 1; i < end; ++i)
+            {
+                lo = lo < tmp[i] ? lo : tmp[i];
+                hi = hi > tmp[i] ? hi : tmp[i];
+            }
+            block_lowest[b] = lo;
+            block_highest[b] = hi;
+        }
+    });
+
+    float lowest = block_lowest[0], highest = block_highest[0];
+    for (size_t b = 1; b < blocks; ++b)
+    {
+        lowest = lowest < block_lowest[b] ? lowest : block_lowest[b];
+        highest = highest > block_highest[b] ? highest : block_highest[b];
     }
 
-    for (size_t i = 0; i < A; ++i) // Scale to [0 ... 1]
-        tmp[i] = (tmp[i] - lowest) / (highest - lowest);
+    // Scale to [0 ... 1]
+    auto scaled = [&](size_t i) { return (tmp[i] - lowest) / (highest - lowest); };
+
+    // The search below only tries thresholds that are multiples of
+    // 1 / SEA_LEVEL_BINS. Bin k holds the heights in [k, k + 1[ / BINS, so
+    // the number of heights below any of them is a sum of whole bins.
+    std::vector<size_t> histogram(blocks * (SEA_LEVEL_BINS + 1), 0);
+    _threadPool->parallelFor(0, blocks, [&](size_t first, size_t last)
+    {
+        for (size_t b = first; b < last; ++b)
+        {
+            size_t* bins = &histogram[b * (SEA_LEVEL_BINS + 1)];
+            const size_t end = std::min(A, (b + 1) * SEA_LEVEL_BLOCK);
+            for (size_t i = b * SEA_LEVEL_BLOCK; i < end; ++i)
+            {
+                const float bin = scaled(i) * SEA_LEVEL_BINS;
+                ++bins[bin < SEA_LEVEL_BINS ? (size_t)bin : SEA_LEVEL_BINS];
+            }
+        }
+    });
+
+    // below[k] is the number of heights under k / SEA_LEVEL_BINS.
+    std::vector<size_t> below(SEA_LEVEL_BINS + 1, 0);
+    for (size_t k = 1; k <= SEA_LEVEL_BINS; ++k)
+    {
+        below[k] = below[k - 1];
+        for (size_t b = 0; b < blocks; ++b)
+            below[k] += histogram[b * (SEA_LEVEL_BINS + 1) + k - 1];
+    }
 
     float sea_threshold = 0.5;
     float th_step = 0.5;
@@ -112,9 +190,7 @@ lithosphere::lithosphere(long seed, size_t width, size_t height, float sea_level
     // ratio defined be "sea_level".
     while (th_step > 0.01)
     {
-        size_t count = 0;
-        for (size_t i = 0; i < A; ++i)
-            count += (tmp[i] < sea_threshold);
+        size_t count = below[(size_t)(sea_threshold * SEA_LEVEL_BINS)];
 
         th_step *= 0.5;
         if (count / (float)A < sea_level)
@@ -123,21 +199,23 @@ lithosphere::lithosphere(long seed, size_t width, size_t height, float sea_level
             sea_threshold -= th_step;
     }
 
-    sea_level = sea_threshold;
-    for (size_t i = 0; i < A; ++i) // Genesis 1:9-10.
-    {
-        tmp[i] = (tmp[i] > sea_level) *
-            (tmp[i] + CONTINENTAL_BASE) + 
-            (tmp[i] <= sea_level) * OCEANIC_BASE;
-    }
-
     // Scalp the +1 away from map side to get a power of two side length!
     // Practically only the redundant map edges become removed.
-    for (size_t y = 0; y < _worldDimension.getHeight(); ++y) {
-        memcpy(&hmap[_worldDimension.lineIndex(y)], 
-               &tmp[ tmpDim.lineIndex(y)],
-               _worldDimension.getWidth()*sizeof(float));
-    }
+    sea_level = sea_threshold;
+    _threadPool->parallelFor(0, _worldDimension.getHeight(), [&](size_t first, size_t last)
+    {
+        for (size_t y = first; y < last; ++y)
+        {
+            float* line = &hmap[_worldDimension.lineIndex(y)];
+            for (size_t x = 0; x < _worldDimension.getWidth(); ++x)
+            {
+                const float h = scaled(tmpDim.indexOf(x, y));
+                line[x] = (h > sea_level) * // Genesis 1:9-10.
+                    (h + CONTINENTAL_BASE) +
+                    (h <= sea_level) * OCEANIC_BASE;
+            }
+        }
+    }, 16);
 
     imap = new size_t[_worldDimension.getArea()];
 
@@ -146,26 +224,590 @@ lithosphere::lithosphere(long seed, size_t width, size_t height, float sea_level
 
 lithosphere::~lithosphere() throw()
 {
-    delete[] plates; plates = 0;
+    delete _stepper;
+    delete _recorder;
+    releasePlates();
+    for (size_t i = 0; i < _platePool.size(); ++i)
+        delete _platePool[i];
     delete[] imap;   imap = 0;
+
+    if (_ownsThreadPool)
+        delete _threadPool;
+    _threadPool = 0;
+}
+
+lithosphere::lithosphere(const WorldDimension& dim, size_t num_threads,
+    float noise_tolerance, bool parallel_growth, bool coalesce_collisions,
+    bool classic_noise) :
+    hmap(dim.getWidth(), dim.getHeight()),
+    imap(new size_t[dim.getArea()]),
+    amap(dim.getWidth(), dim.getHeight()),
+    aggr_overlap_abs(0),
+    aggr_overlap_rel(0),
+    cycle_count(0),
+    erosion_period(0),
+    folding_ratio(0),
+    iter_count(0),
+    max_cycles(0),
+    max_plates(0),
+    num_plates(0),
+    peak_Ek(0),
+    last_coll_count(0),
+    _worldDimension(dim),
+    _randsource(0),
+    _steps(0),
+    _threadPool(num_threads > 0 ? new Platec::ThreadPool(num_threads) :
+                                  &Platec::ThreadPool::shared()),
+    _ownsThreadPool(num_threads > 0),
+    _noiseTolerance(noise_tolerance),
+    _parallelGrowth(parallel_growth),
+    _coalesceCollisions(coalesce_collisions),
+    _classicNoise(classic_noise),
+    _recorder(0),
+    _stepper(0),
+    _publishing(false)
+{
+}
+
+lithosphere* lithosphere::load(const char* path, size_t num_threads)
+{
+    Checkpoint::Reader in(path);
+    const size_t width = in.getSize();
+    const size_t height = in.getSize();
+    if (width == 0 || height == 0 || width * height / height != width ||
+        width * height > MAX_MAP_AREA)
+        throw runtime_error("Problem during load: invalid map size");
+    const float noise_tolerance = in.getFloat();
+    const uint32_t options = in.getU32();
+
+    lithosphere* litho = new lithosphere(WorldDimension(width, height),
+        num_threads, noise_tolerance, (options & OPTION_PARALLEL_GROWTH) != 0,
+        (options & OPTION_COALESCE_COLLISIONS) != 0,
+        (options & OPTION_CLASSIC_NOISE) != 0);
+    try {
+        litho->restore(in);
+        in.finish();
+        return litho;
+    } catch (const exception& e) {
+        delete litho;
+        std::string msg = "Problem during load: ";
+        msg = msg + e.what();
+        throw runtime_error(msg.c_str());
+    }
+}
+
+void lithosphere::restore(Checkpoint::Reader& in)
+{
+    aggr_overlap_abs = in.getSize();
+    aggr_overlap_rel = in.getFloat();
+    cycle_count = in.getSize();
+    erosion_period = in.getSize();
+    folding_ratio = in.getFloat();
+    iter_count = in.getSize();
+    max_cycles = in.getSize();
+    max_plates = in.getSize();
+    const size_t plate_count = in.getSize();
+    if (plate_count > MAX_PLATES)
+        throw runtime_error("too many plates");
+    peak_Ek = in.getFloat();
+    last_coll_count = in.getSize();
+    _randsource.setState(in.getU32());
+    _steps = (int)in.getU32();
+
+    const size_t map_area = _worldDimension.getArea();
+    in.getFloats(hmap.raw_data(), map_area);
+    in.getSizes(imap, map_area);
+    in.getSizes(amap.raw_data(), map_area);
+    // A finished simulation has no plates left but keeps its last map.
+    for (size_t i = 0; i < map_area && plate_count > 0; ++i)
+        if (imap[i] >= plate_count)
+            throw runtime_error("plate index out of range");
+
+    plates.reserve(plate_count);
+    for (size_t i = 0; i < plate_count; ++i)
+        plates.push_back(new plate(in, _worldDimension));
+    num_plates = plate_count;
+
+    collisions.resize(num_plates);
+    subductions.resize(num_plates);
+    for (size_t i = 0; i < num_plates; ++i)
+    {
+        collisions[i].reserve(_worldDimension.largerSize()*4);
+        subductions[i].reserve(_worldDimension.largerSize()*4);
+    }
+}
+
+void lithosphere::save(const char* path) const
+{
+try {
+    Checkpoint::Writer out(path);
+    out.putSize(_worldDimension.getWidth());
+    out.putSize(_worldDimension.getHeight());
+    out.putFloat(_noiseTolerance);
+    out.putU32((_parallelGrowth ? OPTION_PARALLEL_GROWTH : 0) |
+        (_coalesceCollisions ? OPTION_COALESCE_COLLISIONS : 0) |
+        (_classicNoise ? OPTION_CLASSIC_NOISE : 0));
+
+    out.putSize(aggr_overlap_abs);
+    out.putFloat(aggr_overlap_rel);
+    out.putSize(cycle_count);
+    out.putSize(erosion_period);
+    out.putFloat(folding_ratio);
+    out.putSize(iter_count);
+    out.putSize(max_cycles);
+    out.putSize(max_plates);
+    out.putSize(num_plates);
+    out.putFloat(peak_Ek);
+    out.putSize(last_coll_count);
+    out.putU32(_randsource.getState());
+    out.putU32((uint32_t)_steps);
+
+    const size_t map_area = _worldDimension.getArea();
+    out.putFloats(hmap.raw_data(), map_area);
+    out.putSizes(imap, map_area);
+    out.putSizes(amap.raw_data(), map_area);
+    for (size_t i = 0; i < num_plates; ++i)
+        plates[i]->save(out);
+
+    out.commit();
+} catch (const exception& e) {
+    std::string msg = "Problem during save: ";
+    msg = msg + e.what();
+    throw runtime_error(msg.c_str());
+}
+}
+
+lithosphere* lithosphere::fork(size_t _erosion_period, float _folding_ratio,
+    size_t aggr_ratio_abs, float aggr_ratio_rel, size_t num_threads) const
+{
+    lithosphere* litho = new lithosphere(_worldDimension, num_threads,
+        _noiseTolerance, _parallelGrowth, _coalesceCollisions, _classicNoise);
+    try {
+        litho->aggr_overlap_abs = aggr_ratio_abs;
+        litho->aggr_overlap_rel = aggr_ratio_rel;
+        litho->cycle_count = cycle_count;
+        litho->erosion_period = _erosion_period;
+        litho->folding_ratio = _folding_ratio;
+        litho->iter_count = iter_count;
+        litho->max_cycles = max_cycles;
+        litho->max_plates = max_plates;
+        litho->peak_Ek = peak_Ek;
+        litho->last_coll_count = last_coll_count;
+        litho->_randsource = _randsource;
+        litho->_steps = _steps;
+
+        const size_t map_area = _worldDimension.getArea();
+        litho->hmap.from(hmap.raw_data());
+        litho->amap.from(amap.raw_data());
+        memcpy(litho->imap, imap, map_area * sizeof(size_t));
+
+        // Each plate's maps stay shared until either system changes them.
+        litho->plates.reserve(num_plates);
+        for (size_t i = 0; i < num_plates; ++i)
+            litho->plates.push_back(new plate(*plates[i]));
+        litho->num_plates = num_plates;
+
+        litho->collisions.resize(num_plates);
+        litho->subductions.resize(num_plates);
+        for (size_t i = 0; i < num_plates; ++i)
+        {
+            litho->collisions[i].reserve(_worldDimension.largerSize()*4);
+            litho->subductions[i].reserve(_worldDimension.largerSize()*4);
+        }
+        return litho;
+    } catch (...) {
+        delete litho;
+        throw;
+    }
+}
+
+void lithosphere::stepAsync(size_t max_queued)
+{
+    if (!_stepper)
+        _stepper = new asyncStepper(*this);
+    _stepper->step(max_queued > 0 ? max_queued : 1);
+}
+
+void lithosphere::wait()
+{
+    if (_stepper)
+        _stepper->wait();
+}
+
+void lithosphere::startPublishing()
+{
+    _publishing = true;
+    _publisher.publish(_steps, hmap.raw_data(), imap, amap.raw_data(),
+        _worldDimension.getArea());
+}
+
+void lithosphere::stepFinished()
+{
+    if (_recorder)
+        _recorder->add(_steps, hmap.raw_data(), imap);
+    if (_publishing)
+        _publisher.publish(_steps, hmap.raw_data(), imap, amap.raw_data(),
+            _worldDimension.getArea());
+}
+
+void lithosphere::startRecording(const char* path, size_t interval)
+{
+    stopRecording();
+    _recorder = new frameRecorder(path, _worldDimension.getWidth(),
+        _worldDimension.getHeight(), interval);
+}
+
+void lithosphere::stopRecording()
+{
+    frameRecorder* recorder = _recorder;
+    _recorder = 0;
+    try {
+        if (recorder)
+            recorder->close();
+    } catch (...) {
+        delete recorder;
+        throw;
+    }
+    delete recorder;
+}
+
+void lithosphere::releasePlates()
+{
+    _platePool.insert(_platePool.end(), plates.begin(), plates.end());
+    plates.clear();
+    num_plates = 0;
+}
+
+/**
+ * Grow plates from their origins in parallel.
+ *
+ * Every pixel costs a random amount to enter and goes to the plate that
+ * reaches it cheapest, ties going to the smaller plate index. That is
+ * first-passage percolation, whose clusters look like those grown one
+ * random border pixel at a time, but the result doesn't depend on the order
+ * in which costs are relaxed. The map is split into tiles that are relaxed
+ * independently and again whenever a neighbour changes their edge, so the
+ * same seed gives the same plates on any number of threads.
+ *
+ * @param owner Plate index of every pixel; the origins must already be set
+ *              and all other pixels must be at least num_plates.
+ */
+static void growPlates(size_t* owner, const WorldDimension& dim,
+                       size_t num_plates, uint32_t seed,
+                       Platec::ThreadPool* pool)
+{
+    const size_t T = GROWTH_TILE;
+    const size_t W = dim.getWidth(), H = dim.getHeight();
+    const size_t tiles_x = (W + T - 1) / T, tiles_y = (H + T - 1) / T;
+
+    // Tiles are stored one after another to keep each of them in cache.
+    auto tiled = [&](size_t x, size_t y)
+    {
+        return ((y / T) * tiles_x + x / T) * T * T + (y % T) * T + x % T;
+    };
+
+    // Costs are roughly exponentially distributed like the waiting times
+    // of the random picks: the number of leading zeros of 24 random bits,
+    // read from the exponent of their exact float value, is geometric and
+    // three more bits dither it.
+    // A pixel's label is its cost in the high and its owner in the low
+    // half, so that the smallest label wins ties by the plate index.
+    const CounterRandom random(seed);
+    std::vector<unsigned char> weight(tiles_x * tiles_y * T * T);
+    std::vector<uint64_t> label(tiles_x * tiles_y * T * T);
+    pool->parallelFor(0, H, [&](size_t first, size_t last)
+    {
+        for (size_t y = first; y < last; ++y)
+            for (size_t x = 0; x < W; ++x)
+            {
+                const size_t i = y * W + x, j = tiled(x, y);
+                const uint32_t r = random.at(i);
+                const float f = (float)((r >> 8) | 1);
+                uint32_t bits;
+                memcpy(&bits, &f, sizeof(bits));
+                const uint32_t zeros = 23 - ((bits >> 23) - 127);
+                weight[j] = (unsigned char)(1 + 8 * zeros + (r & 7));
+                label[j] = owner[i] < num_plates ? owner[i] :
+                    (uint64_t)GROWTH_UNREACHED << 32 | 0xffffffffu;
+            }
+    }, 16);
+
+    // Relax a tile from its origins and from the changed labels around it
+    // in the order of cost (Dial's algorithm: weights are below 256, so a
+    // ring of 256 buckets holds every pending cost). Returns which edges
+    // changed: 1 = top, 2 = bottom, 4 = left, 8 = right.
+    typedef std::vector<std::vector<unsigned short> > Buckets;
+    auto relaxTile = [&](size_t tx, size_t ty, bool origins,
+                         Buckets& buckets, std::vector<uint64_t>& sources)
+    {
+        const size_t x0 = tx * T, wdt = std::min(W, x0 + T) - x0;
+        const size_t y0 = ty * T, hgt = std::min(H, y0 + T) - y0;
+        uint64_t* tile = &label[(ty * tiles_x + tx) * T * T];
+        const unsigned char* cost_of = &weight[(ty * tiles_x + tx) * T * T];
+        unsigned edges = 0;
+
+        // Label the p:th pixel of the tile from label l if that's better.
+        auto enter = [&](size_t p, uint64_t l)
+        {
+            l += (uint64_t)cost_of[p] << 32;
+            if (l >= tile[p])
+                return false;
+            tile[p] = l;
+            const size_t x = p % T, y = p / T;
+            edges |= (y == 0) | (y == hgt - 1) << 1 |
+                     (x == 0) << 2 | (x == wdt - 1) << 3;
+            return true;
+        };
+
+        // Start from the labels that improve from outside, in cost order.
+        sources.clear();
+        auto enterFrom = [&](size_t p, size_t x, size_t y)
+        {
+            if (enter(p, label[tiled(x, y)]))
+                sources.push_back((tile[p] >> 32) << 32 | p);
+        };
+        for (size_t x = 0; x < wdt; ++x)
+        {
+            enterFrom(x, x0 + x, y0 > 0 ? y0 - 1 : H - 1);
+            enterFrom((hgt - 1) * T + x, x0 + x, y0 + hgt < H ? y0 + hgt : 0);
+        }
+        for (size_t y = 0; y < hgt; ++y)
+        {
+            enterFrom(y * T, x0 > 0 ? x0 - 1 : W - 1, y0 + y);
+            enterFrom(y * T + wdt - 1, x0 + wdt < W ? x0 + wdt : 0, y0 + y);
+        }
+        if (origins)
+            for (size_t y = 0; y < hgt; ++y)
+                for (size_t p = y * T; p < y * T + wdt; ++p)
+                    if (tile[p] >> 32 == 0)
+                        sources.push_back(p);
+
+        std::sort(sources.begin(), sources.end());
+        size_t next = 0, pending = 0;
+        uint64_t cost = sources.empty() ? 0 : sources[0] >> 32;
+        auto queue = [&](size_t p, uint64_t l)
+        {
+            if (enter(p, l))
+            {
+                buckets[(tile[p] >> 32) & 255].push_back((unsigned short)p);
+                ++pending;
+            }
+        };
+        while (next < sources.size() || pending > 0)
+        {
+            for (; next < sources.size() && sources[next] >> 32 < cost + 256; ++next)
+            {
+                buckets[(sources[next] >> 32) & 255].push_back(
+                    (unsigned short)sources[next]);
+                ++pending;
+            }
+            if (pending == 0)
+            {
+                cost = sources[next] >> 32;
+                continue;
+            }
+
+            // Weights are positive, so the current bucket doesn't grow.
+            std::vector<unsigned short>& bucket = buckets[cost & 255];
+            for (size_t k = 0; k < bucket.size(); ++k)
+            {
+                const size_t p = bucket[k];
+                const uint64_t l = tile[p];
+                if (l >> 32 != cost)
+                    continue; // Queued again with a smaller cost.
+
+                const size_t x = p % T, y = p / T;
+                if (y > 0)
+                    queue(p - T, l);
+                if (y < hgt - 1)
+                    queue(p + T, l);
+                if (x > 0)
+                    queue(p - 1, l);
+                if (x < wdt - 1)
+                    queue(p + 1, l);
+            }
+            pending -= bucket.size();
+            bucket.clear();
+            ++cost;
+        }
+        return edges;
+    };
+
+    // Tiles of the same phase share no edges and can be relaxed at once.
+    // An odd tile count around the wrap needs a third colour.
+    auto colour = [](size_t t, size_t n)
+    {
+        return n > 1 && n % 2 && t == n - 1 ? 2 : t % 2;
+    };
+
+    std::vector<unsigned char> active(tiles_x * tiles_y, 0);
+    std::vector<unsigned> edges(tiles_x * tiles_y, 0);
+    for (size_t i = 0; i < W * H; ++i)
+        if (owner[i] < num_plates)
+            active[(i / W / T) * tiles_x + i % W / T] = 1;
+
+    std::vector<size_t> phase;
+    bool any = true, origins = true;
+    while (any)
+    {
+        for (size_t c = 0; c < 9; ++c)
+        {
+            phase.clear();
+            for (size_t t = 0; t < tiles_x * tiles_y; ++t)
+                if (active[t] && colour(t % tiles_x, tiles_x) == c % 3 &&
+                    colour(t / tiles_x, tiles_y) == c / 3)
+                    phase.push_back(t);
+
+            pool->parallelFor(0, phase.size(), [&](size_t first, size_t last)
+            {
+                Buckets buckets(256);
+                std::vector<uint64_t> sources;
+                for (size_t k = first; k < last; ++k)
+                    edges[phase[k]] = relaxTile(phase[k] % tiles_x,
+                        phase[k] / tiles_x, origins, buckets, sources);
+            });
+        }
+        origins = false;
+
+        // Wake up the neighbours of the changed edges.
+        any = false;
+        std::fill(active.begin(), active.end(), 0);
+        for (size_t t = 0; t < tiles_x * tiles_y; ++t)
+        {
+            const size_t tx = t % tiles_x, ty = t / tiles_x;
+            if (edges[t] & 1)
+                active[((ty + tiles_y - 1) % tiles_y) * tiles_x + tx] = 1;
+            if (edges[t] & 2)
+                active[((ty + 1) % tiles_y) * tiles_x + tx] = 1;
+            if (edges[t] & 4)
+                active[ty * tiles_x + (tx + tiles_x - 1) % tiles_x] = 1;
+            if (edges[t] & 8)
+                active[ty * tiles_x + (tx + 1) % tiles_x] = 1;
+            any |= edges[t] != 0;
+            edges[t] = 0;
+        }
+    }
+
+    pool->parallelFor(0, H, [&](size_t first, size_t last)
+    {
+        for (size_t y = first; y < last; ++y)
+            for (size_t x = 0; x < W; ++x)
+                owner[y * W + x] = (size_t)(label[tiled(x, y)] & 0xffffffffu);
+    }, 16);
+}
+
+/**
+ * Find the first pixel after the largest run of free pixels on a circle.
+ *
+ * @param occupied Flags of the n pixels of a wrapping row or column.
+ * @param first Set to the start of the shortest span covering all flags.
+ * @param span Set to the length of that span.
+ */
+static void findSpan(const unsigned char* occupied, size_t n,
+                     size_t& first, size_t& span)
+{
+    size_t start = 0;
+    while (start < n && !occupied[start])
+        ++start;
+
+    first = 0;
+    size_t gap = 0, run = 0;
+    for (size_t k = 1; k <= n; ++k)
+    {
+        const size_t i = (start + k) % n;
+        if (!occupied[i])
+            ++run;
+        else
+        {
+            if (run > gap)
+            {
+                gap = run;
+                first = i;
+            }
+            run = 0;
+        }
+    }
+    span = n - gap;
+}
+
+/**
+ * Set the bounding boxes of the plates to the smallest wrapping rectangles.
+ *
+ * The ownership map is read once. Every block of rows flags the rows its
+ * plates occupy and collects their columns into bit sets of its own, which
+ * are merged afterwards.
+ */
+static void findPlateBounds(const size_t* owner, const WorldDimension& dim,
+                            size_t num_plates, plateArea* area,
+                            Platec::ThreadPool* pool)
+{
+    const size_t W = dim.getWidth(), H = dim.getHeight();
+    const size_t words = (W + 63) / 64;
+    const size_t blocks = std::min(H, PLATE_BOUNDS_BLOCKS);
+    std::vector<unsigned char> rows(num_plates * H, 0);
+    std::vector<uint64_t> cols(blocks * num_plates * words, 0);
+
+    pool->parallelFor(0, blocks, [&](size_t first, size_t last)
+    {
+        for (size_t b = first; b < last; ++b)
+        {
+            uint64_t* bits = &cols[b * num_plates * words];
+            for (size_t y = H * b / blocks; y < H * (b + 1) / blocks; ++y)
+            {
+                const size_t* line = &owner[y * W];
+                size_t prev = line[0];
+                rows[prev * H + y] = 1;
+                for (size_t x = 0; x < W; ++x)
+                {
+                    // Plates come in runs, so most pixels only set a bit.
+                    if (line[x] != prev)
+                    {
+                        prev = line[x];
+                        rows[prev * H + y] = 1;
+                    }
+                    bits[prev * words + x / 64] |= (uint64_t)1 << (x % 64);
+                }
+            }
+        }
+    });
+
+    std::vector<unsigned char> occupied(W);
+    for (size_t i = 0; i < num_plates; ++i)
+    {
+        for (size_t w = 0; w < words; ++w)
+        {
+            uint64_t bits = 0;
+            for (size_t b = 0; b < blocks; ++b)
+                bits |= cols[(b * num_plates + i) * words + w];
+            for (size_t x = w * 64; x < std::min(W, w * 64 + 64); ++x)
+                occupied[x] = (bits >> (x % 64)) & 1;
+        }
+
+        findSpan(&occupied[0], W, area[i].lft, area[i].wdt);
+        findSpan(&rows[i * H], H, area[i].top, area[i].hgt);
+        area[i].rgt = dim.xMod(area[i].lft + area[i].wdt - 1);
+        area[i].btm = dim.yMod(area[i].top + area[i].hgt - 1);
+    }
 }
 
 void lithosphere::createPlates(size_t num_plates)
 {
 try {    
     const size_t map_area = _worldDimension.getArea();
+    if (num_plates > MAX_PLATES)
+        throw invalid_argument("too many plates");
+    releasePlates();
     this->max_plates = this->num_plates = num_plates;
 
-    std::vector<plateCollision> vec;
-    vec.reserve(_worldDimension.largerSize()*4); // == map's circumference.
-
-    collisions.reserve(num_plates);
-    subductions.reserve(num_plates);
+    // Lists left from earlier cycles keep their capacity.
+    collisions.resize(num_plates);
+    subductions.resize(num_plates);
 
     for (size_t i = 0; i < num_plates; ++i)
     {
-        collisions.push_back(vec);
-        subductions.push_back(vec);
+        // Reserve room for the map's circumference.
+        collisions[i].reserve(_worldDimension.largerSize()*4);
+        subductions[i].reserve(_worldDimension.largerSize()*4);
     }
 
     // Initialize "Free plate center position" lookup table.
@@ -196,87 +838,107 @@ try {
     size_t* owner = imap; // Create an alias.
     memset(owner, 255, map_area * sizeof(size_t));
 
-    // "Grow" plates from their origins until surface is fully populated.
-    size_t max_border = 1;
-    size_t i;
-    while (max_border) {
-        for (max_border = i = 0; i < num_plates; ++i) {
-            const size_t N = area[i].border.size();
-            max_border = max_border > N ? max_border : N;
-
-            if (N == 0)
-                continue;
-
-            const size_t j = _randsource.next() % N;
-            const size_t p = area[i].border[j];
-            const size_t cy = _worldDimension.yFromIndex(p);
-            const size_t cx = _worldDimension.xFromIndex(p);
-
-            const size_t lft = cx > 0 ? cx - 1 : _worldDimension.getWidth() - 1;
-            const size_t rgt = cx < _worldDimension.getWidth() - 1 ? cx + 1 : 0;
-            const size_t top = cy > 0 ? cy - 1 : _worldDimension.getHeight() - 1;
-            const size_t btm = cy < _worldDimension.getHeight() - 1 ? cy + 1 : 0;
-
-            const size_t n = top * _worldDimension.getWidth() +  cx; // North.
-            const size_t s = btm * _worldDimension.getWidth() +  cx; // South.
-            const size_t w =  cy * _worldDimension.getWidth() + lft; // West.
-            const size_t e =  cy * _worldDimension.getWidth() + rgt; // East.
-
-            if (owner[n] >= num_plates)
-            {
-                owner[n] = i;
-                area[i].border.push_back(n);
+    if (_parallelGrowth)
+    {
+        for (size_t i = 0; i < num_plates; ++i)
+            owner[area[i].border[0]] = i;
 
-                if (area[i].top == _worldDimension.yMod(top + 1))
+        growPlates(owner, _worldDimension, num_plates,
+                   (uint32_t)_randsource.next(), _threadPool);
+        findPlateBounds(owner, _worldDimension, num_plates, area,
+                        _threadPool);
+    }
+    else
+    {
+        // "Grow" plates from their origins until surface is fully populated.
+        // A plate grows one neighbour at a time, so a pixel beyond its box
+        // is always next to the box and extends it by exactly one. Only a
+        // plate that wraps around the whole world ends up with a box larger
+        // than the map, which is capped to the map below; its box then
+        // starts where it last grew instead of at the first free column or
+        // row. The origin of such a box shifts all later positions of the
+        // plate, so it's kept to give the same worlds as before.
+        size_t max_border = 1;
+        size_t i;
+        while (max_border) {
+            for (max_border = i = 0; i < num_plates; ++i) {
+                const size_t N = area[i].border.size();
+                max_border = max_border > N ? max_border : N;
+
+                if (N == 0)
+                    continue;
+
+                const size_t j = _randsource.next() % N;
+                const size_t p = area[i].border[j];
+                const size_t cy = _worldDimension.yFromIndex(p);
+                const size_t cx = _worldDimension.xFromIndex(p);
+
+                const size_t lft = cx > 0 ? cx - 1 : _worldDimension.getWidth() - 1;
+                const size_t rgt = cx < _worldDimension.getWidth() - 1 ? cx + 1 : 0;
+                const size_t top = cy > 0 ? cy - 1 : _worldDimension.getHeight() - 1;
+                const size_t btm = cy < _worldDimension.getHeight() - 1 ? cy + 1 : 0;
+
+                const size_t n = top * _worldDimension.getWidth() +  cx; // North.
+                const size_t s = btm * _worldDimension.getWidth() +  cx; // South.
+                const size_t w =  cy * _worldDimension.getWidth() + lft; // West.
+                const size_t e =  cy * _worldDimension.getWidth() + rgt; // East.
+
+                if (owner[n] >= num_plates)
                 {
-                    area[i].top = top;
-                    area[i].hgt++;
+                    owner[n] = i;
+                    area[i].border.push_back(n);
+
+                    if (area[i].top == _worldDimension.yMod(top + 1))
+                    {
+                        area[i].top = top;
+                        area[i].hgt++;
+                    }
                 }
-            }
 
-            if (owner[s] >= num_plates)
-            {
-                owner[s] = i;
-                area[i].border.push_back(s);
-
-                if (btm == _worldDimension.yMod(area[i].btm + 1))
+                if (owner[s] >= num_plates)
                 {
-                    area[i].btm = btm;
-                    area[i].hgt++;
+                    owner[s] = i;
+                    area[i].border.push_back(s);
+
+                    if (btm == _worldDimension.yMod(area[i].btm + 1))
+                    {
+                        area[i].btm = btm;
+                        area[i].hgt++;
+                    }
                 }
-            }
 
-            if (owner[w] >= num_plates)
-            {
-                owner[w] = i;
-                area[i].border.push_back(w);
-
-                if (area[i].lft == _worldDimension.xMod(lft + 1))
+                if (owner[w] >= num_plates)
                 {
-                    area[i].lft = lft;
-                    area[i].wdt++;
+                    owner[w] = i;
+                    area[i].border.push_back(w);
+
+                    if (area[i].lft == _worldDimension.xMod(lft + 1))
+                    {
+                        area[i].lft = lft;
+                        area[i].wdt++;
+                    }
                 }
-            }
-
-            if (owner[e] >= num_plates)
-            {
-                owner[e] = i;
-                area[i].border.push_back(e);
 
-                if (rgt == _worldDimension.xMod(area[i].rgt + 1))
+                if (owner[e] >= num_plates)
                 {
-                    area[i].rgt = rgt;
-                    area[i].wdt++;
+                    owner[e] = i;
+                    area[i].border.push_back(e);
+
+                    if (rgt == _worldDimension.xMod(area[i].rgt + 1))
+                    {
+                        area[i].rgt = rgt;
+                        area[i].wdt++;
+                    }
                 }
-            }
 
-            // Overwrite processed point with unprocessed one.
-            area[i].border[j] = area[i].border.back();
-            area[i].border.pop_back();
+                // Overwrite processed point with unprocessed one.
+                area[i].border[j] = area[i].border.back();
+                area[i].border.pop_back();
+            }
         }
     }
 
-    plates = new plate*[num_plates];
+    plates.resize(num_plates);
 
     // Extract and create plates from initial terrain.
     for (size_t i = 0; i < num_plates; ++i)
@@ -290,7 +952,9 @@ try {
         const size_t y1 = 1 + y0 + area[i].hgt;
         const size_t width = x1 - x0;
         const size_t height = y1 - y0;
-        float* plt = new float[width * height];
+        if (_plateBuffer.size() < width * height)
+            _plateBuffer.resize(width * height);
+        float* plt = &_plateBuffer[0];
 
         // Copy plate's height data from global map into local map.
         for (size_t y = y0, j = 0; y < y1; ++y)
@@ -300,9 +964,16 @@ try {
                 plt[j] = hmap[k] * (owner[k] == i);
             }
 
-        // Create plate.
-        plates[i] = new plate(_randsource.next(), plt, width, height, x0, y0, i, _worldDimension);
-        delete[] plt;
+        // Create plate, recycling an old one if possible.
+        const long seed = _randsource.next();
+        if (_platePool.empty())
+            plates[i] = new plate(seed, plt, width, height, x0, y0, i, _worldDimension);
+        else
+        {
+            plates[i] = _platePool.back();
+            _platePool.pop_back();
+            plates[i]->reset(seed, plt, width, height, x0, y0, i);
+        }
     }
 
     iter_count = num_plates + MAX_BUOYANCY_AGE;
@@ -318,16 +989,22 @@ try {
 
 size_t lithosphere::getPlateCount() const throw()
 {
+    if (_stepper && _stepper->isBusy())
+        return _stepper->getPlateCount();
     return num_plates;
 } 
 
 const size_t* lithosphere::getAgemap() const throw()
 {
+    if (_stepper && _stepper->isBusy())
+        return _stepper->getAgemap();
     return amap.raw_data();
 }
 
 float* lithosphere::getTopography() const throw()
 {
+    if (_stepper && _stepper->isBusy())
+        return _stepper->getTopography();
     return hmap.raw_data();
 }
 
@@ -362,6 +1039,7 @@ try {
         iter_count > 600)
     {
         restart();
+        stepFinished();
         return;
     }
 
@@ -370,15 +1048,21 @@ try {
     imap = new size_t[map_area];
 
     // Realize accumulated external forces to each plate.
-    for (size_t i = 0; i < num_plates; ++i)
+    // Plates don't touch each other here, so they can be handled in any
+    // order and on any thread.
+    const bool erode = erosion_period > 0 && iter_count % erosion_period == 0;
+    _threadPool->parallelFor(0, num_plates, [this, erode](size_t first, size_t last)
     {
-        plates[i]->resetSegments();
+        for (size_t i = first; i < last; ++i)
+        {
+            plates[i]->resetSegments();
 
-        if (erosion_period > 0 && iter_count % erosion_period == 0)
-            plates[i]->erode(CONTINENTAL_BASE);
+            if (erode)
+                plates[i]->erode(CONTINENTAL_BASE);
 
-        plates[i]->move();
-    }
+            plates[i]->move();
+        }
+    });
 
     size_t oceanic_collisions = 0;
     size_t continental_collisions = 0;
@@ -397,6 +1081,8 @@ try {
       const size_t x1 = x0 + plates[i]->getWidth();
       const size_t y1 = y0 + plates[i]->getHeight();
 
+      // Setting this plate's crust below may give it copies of maps it
+      // shares with a fork, so the pointers are fetched again after that.
       const float*  this_map;
       const size_t* this_age;
       plates[i]->getMap(&this_map, &this_age);
@@ -450,8 +1136,7 @@ try {
                 CONTINENTAL_BASE;
 
             // Save collision to the receiving plate's list.
-            plateCollision coll(i, x_mod, y_mod, sediment);
-            subductions[imap[k]].push_back(coll);
+            subductions[imap[k]].push(i, k, sediment);
             ++oceanic_collisions;
 
             // Remove subducted oceanic lithosphere from plate.
@@ -461,6 +1146,7 @@ try {
             //    crust from other subductions/collisions.
             plates[i]->setCrust(x_mod, y_mod, this_map[j] -
                 OCEANIC_BASE, this_timestamp);
+            plates[i]->getMap(&this_map, &this_age);
 
             if (this_map[j] <= 0)
                 continue; // Nothing more to collide.
@@ -471,8 +1157,7 @@ try {
                 (CONTINENTAL_BASE - hmap[k]) /
                 CONTINENTAL_BASE;
 
-            plateCollision coll(imap[k], x_mod, y_mod, sediment);
-            subductions[i].push_back(coll);
+            subductions[i].push(imap[k], k, sediment);
             ++oceanic_collisions;
 
             plates[imap[k]]->setCrust(x_mod, y_mod, hmap[k] -
@@ -498,34 +1183,34 @@ try {
         // Move some crust from the SMALLER plate onto LARGER one.
         if (this_area < prev_area)
         {
-            plateCollision coll(imap[k], x_mod, y_mod,
-                this_map[j] * folding_ratio);
+            const float folded = this_map[j] * folding_ratio;
 
             // Give some...
-            hmap[k] += coll.crust;
+            hmap[k] += folded;
             plates[imap[k]]->setCrust(x_mod, y_mod, hmap[k],
                 this_age[j]);
 
             // And take some.
             plates[i]->setCrust(x_mod, y_mod, this_map[j] *
                 (1.0 - folding_ratio), this_age[j]);
+            plates[i]->getMap(&this_map, &this_age);
 
             // Add collision to the earlier plate's list.
-            collisions[i].push_back(coll);
+            collisions[i].push(imap[k], k, folded);
             ++continental_collisions;
         }
         else
         {
-            plateCollision coll(i, x_mod, y_mod,
-                hmap[k] * folding_ratio);
+            const float folded = hmap[k] * folding_ratio;
 
             plates[i]->setCrust(x_mod, y_mod,
-                this_map[j]+coll.crust, amap[k]);
+                this_map[j]+folded, amap[k]);
+            plates[i]->getMap(&this_map, &this_age);
 
             plates[imap[k]]->setCrust(x_mod, y_mod, hmap[k]
                 * (1.0 - folding_ratio), amap[k]);
 
-            collisions[imap[k]].push_back(coll);
+            collisions[imap[k]].push(i, k, folded);
             ++continental_collisions;
 
             // Give the location to the larger plate.
@@ -540,11 +1225,17 @@ try {
     last_coll_count = (last_coll_count + 1) &
         -(continental_collisions == 0);
 
-    for (size_t i = 0; i < num_plates; ++i)
+    // Subduction only changes the receiving plate and draws from its own
+    // random source, while the other plates' velocities stay untouched.
+    // Each plate's list is therefore handled on its own thread, in the
+    // order it was recorded so that every pixel gets the same random offset.
+    _threadPool->parallelFor(0, num_plates, [this](size_t first, size_t last)
     {
+      for (size_t i = first; i < last; ++i)
+      {
         for (size_t j = 0; j < subductions[i].size(); ++j)
         {
-            const plateCollision& coll = subductions[i][j];
+            const plateCollision coll = getCollision(subductions[i], j);
 
             #ifdef DEBUG
             if (i == coll.index)
@@ -564,72 +1255,54 @@ try {
         }
 
         subductions[i].clear();
-    }
+      }
+    });
 
-    for (size_t i = 0; i < num_plates; ++i)
+    // Continental collisions change both plates involved, in the order
+    // they were recorded. Collisions between disjoint pairs of plates may
+    // still run at the same time, see scheduleCollisions.
+    if (_coalesceCollisions)
+        for (size_t i = 0; i < num_plates; ++i)
+            coalesceCollisions(i);
+
+    if (_threadPool->getWorkerCount() == 1)
     {
-        for (size_t j = 0; j < collisions[i].size(); ++j)
+        for (size_t i = 0; i < num_plates; ++i)
+            for (size_t j = 0; j < collisions[i].size(); ++j)
+                processCollision(i, getCollision(collisions[i], j));
+    }
+    else
+    {
+        scheduleCollisions();
+        for (size_t r = 0; r + 1 < _roundStarts.size(); ++r)
         {
-            const plateCollision& coll = collisions[i][j];
-            size_t coll_count, coll_count_i, coll_count_j;
-            float coll_ratio, coll_ratio_i, coll_ratio_j;
-
-            #ifdef DEBUG
-            if (i == coll.index)
+            const size_t first_run = _roundStarts[r];
+            const size_t num_runs = _roundStarts[r + 1] - first_run;
+            auto runs = [this, first_run](size_t first, size_t last)
             {
-                puts("when colliding: SRC == DEST!");
-                exit(1);
-            }
-            #endif
+                for (size_t k = first_run + first; k < first_run + last; ++k)
+                {
+                    const collisionRun& run = _collisionRuns[k];
+                    for (size_t j = run.first; j < run.last; ++j)
+                        processCollision(run.plate,
+                            getCollision(collisions[run.plate], j));
+                }
+            };
 
-            // Collision causes friction. Apply it to both plates.
-            plates[i]->applyFriction(coll.crust);
-            plates[coll.index]->applyFriction(coll.crust);
-
-            plates[i]->getCollisionInfo(coll.wx, coll.wy,
-                &coll_count_i, &coll_ratio_i);
-            plates[coll.index]->getCollisionInfo(coll.wx,
-                coll.wy, &coll_count_j, &coll_ratio_j);
-
-            // Find the minimum count of collisions between two
-            // continents on different plates.
-            // It's minimum because large plate will get collisions
-            // from all over where as smaller plate will get just
-            // a few. It's those few that matter between these two
-            // plates, not what the big plate has with all the
-            // other plates around it.
-            coll_count = coll_count_i;
-            coll_count -= (coll_count - coll_count_j) &
-                -(coll_count > coll_count_j);
-
-            // Find maximum amount of collided surface area between
-            // two continents on different plates.
-            // Like earlier, it's the "experience" of the smaller
-            // plate that matters here.
-            coll_ratio = coll_ratio_i;
-            coll_ratio += (coll_ratio_j - coll_ratio) *
-                (coll_ratio_j > coll_ratio);
-
-            if ((coll_count > aggr_overlap_abs) |
-                (coll_ratio > aggr_overlap_rel))
-            {
-                float amount = plates[i]->aggregateCrust(
-                        plates[coll.index],
-                        coll.wx, coll.wy);
-
-                // Calculate new direction and speed for the
-                // merged plate system, that is, for the
-                // receiving plate!
-                plates[coll.index]->collide(*plates[i],
-                    coll.wx, coll.wy, amount);
-            }
+            // Most rounds hold a single run, not worth waking the pool.
+            if (num_runs == 1)
+                runs(0, 1);
+            else
+                _threadPool->parallelFor(0, num_runs, runs);
         }
+    }
 
+    for (size_t i = 0; i < num_plates; ++i)
         collisions[i].clear();
-      }
 
     size_t* indexFound = new size_t[num_plates];
     memset(indexFound, 0, sizeof(size_t)*num_plates);
+    _divergentPixels.resize(num_plates);
 
     // Fill divergent boundaries with new crustal material, molten magma.
     for (size_t y = 0, i = 0; y < BOOL_REGENERATE_CRUST * _worldDimension.getHeight(); ++y)
@@ -655,9 +1328,11 @@ try {
             amap[i] = iter_count;
             hmap[i] = OCEANIC_BASE * BUOYANCY_BONUS_X;
 
-            plates[imap[i]]->setCrust(x, y, OCEANIC_BASE,
-                iter_count);
+            // Given to the plate below, all at once.
+            _divergentPixels[imap[i]].push_back((uint32_t)i);
 
+            // The plate owns this point now, so it's not empty.
+            ++indexFound[imap[i]];
         }
         else if (++indexFound[imap[i]] && hmap[i] <= 0)
         {
@@ -665,13 +1340,27 @@ try {
             exit(1);
         }
 
+    // Each plate grows at most once to make room for its new crust, and
+    // plates don't share anything here, so they are handled in parallel.
+    _threadPool->parallelFor(0, num_plates, [this](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            std::vector<uint32_t>& pixels = _divergentPixels[i];
+            if (!pixels.empty())
+                plates[i]->setCrust(&pixels[0], pixels.size(),
+                    OCEANIC_BASE, iter_count);
+            pixels.clear();
+        }
+    });
+
     // Remove empty plates from the system.
     for (size_t i = 0; i < num_plates; ++i)
         if (num_plates == 1)
             puts("ONLY ONE PLATE LEFT!");
         else if (indexFound[i] == 0)
         {
-            delete plates[i];
+            _platePool.push_back(plates[i]);
             plates[i] = plates[num_plates - 1];
             indexFound[i] = indexFound[num_plates - 1];
 
@@ -682,6 +1371,7 @@ try {
                 if (imap[j] == num_plates - 1)
                     imap[j] = i;
 
+            plates.pop_back();
             --num_plates;
             --i;
         }
@@ -689,21 +1379,13 @@ try {
     delete[] indexFound;
 
     // Add some "virginity buoyancy" to all pixels for a visual boost! :)
-    for (size_t i = 0; i < (BUOYANCY_BONUS_X > 0) * map_area; ++i)
-    {
-        // Calculate the inverted age of this piece of crust.
-        // Force result to be minimum between inv. age and
-        // max buoyancy bonus age.
-        size_t crust_age = iter_count - amap[i];
-        crust_age = MAX_BUOYANCY_AGE - crust_age;
-        crust_age &= -(crust_age <= MAX_BUOYANCY_AGE);
-
-        hmap[i] += (hmap[i] < CONTINENTAL_BASE) * BUOYANCY_BONUS_X *
-                   OCEANIC_BASE * crust_age * MULINV_MAX_BUOYANCY_AGE;
-    }
+    if (BUOYANCY_BONUS_X > 0)
+        addBuoyancy(hmap.raw_data(), amap.raw_data(), map_area, iter_count,
+            MAX_BUOYANCY_AGE, BUOYANCY_BONUS_X * OCEANIC_BASE, CONTINENTAL_BASE);
 
     delete[] prev_imap;
     ++iter_count;
+    stepFinished();
 } catch (const exception& e){
     std::string msg = "Problem during update: ";
     msg = msg + e.what();
@@ -711,6 +1393,145 @@ try {
 }
 }
 
+lithosphere::plateCollision lithosphere::getCollision(
+    const collisionList& list, size_t j) const
+{
+    const size_t k = list.location[j];
+    return plateCollision(list.index[j], k % _worldDimension.getWidth(),
+        k / _worldDimension.getWidth(), list.crust[j]);
+}
+
+void lithosphere::processCollision(size_t i, const plateCollision& coll)
+{
+    size_t coll_count, coll_count_i, coll_count_j;
+    float coll_ratio, coll_ratio_i, coll_ratio_j;
+
+    #ifdef DEBUG
+    if (i == coll.index)
+    {
+        puts("when colliding: SRC == DEST!");
+        exit(1);
+    }
+    #endif
+
+    // Collision causes friction. Apply it to both plates.
+    plates[i]->applyFriction(coll.crust);
+    plates[coll.index]->applyFriction(coll.crust);
+
+    plates[i]->getCollisionInfo(coll.wx, coll.wy,
+        &coll_count_i, &coll_ratio_i);
+    plates[coll.index]->getCollisionInfo(coll.wx,
+        coll.wy, &coll_count_j, &coll_ratio_j);
+
+    // Find the minimum count of collisions between two
+    // continents on different plates.
+    // It's minimum because large plate will get collisions
+    // from all over where as smaller plate will get just
+    // a few. It's those few that matter between these two
+    // plates, not what the big plate has with all the
+    // other plates around it.
+    coll_count = coll_count_i;
+    coll_count -= (coll_count - coll_count_j) &
+        -(coll_count > coll_count_j);
+
+    // Find maximum amount of collided surface area between
+    // two continents on different plates.
+    // Like earlier, it's the "experience" of the smaller
+    // plate that matters here.
+    coll_ratio = coll_ratio_i;
+    coll_ratio += (coll_ratio_j - coll_ratio) *
+        (coll_ratio_j > coll_ratio);
+
+    if ((coll_count > aggr_overlap_abs) |
+        (coll_ratio > aggr_overlap_rel))
+    {
+        float amount = plates[i]->aggregateCrust(
+                plates[coll.index],
+                coll.wx, coll.wy);
+
+        // Calculate new direction and speed for the
+        // merged plate system, that is, for the
+        // receiving plate!
+        plates[coll.index]->collide(*plates[i],
+            coll.wx, coll.wy, amount);
+    }
+}
+
+void lithosphere::scheduleCollisions()
+{
+    // Split each list into runs of collisions with the same plate. A run
+    // may start once the previous runs of both of its plates are done, so
+    // it goes to the round after the later of them. The runs of a round
+    // never share a plate and every plate sees its runs in list order.
+    _collisionRuns.clear();
+    _plateRounds.assign(num_plates, 0);
+    size_t num_rounds = 0;
+    for (size_t i = 0; i < num_plates; ++i)
+        for (size_t j = 0; j < collisions[i].size(); ++j)
+        {
+            const size_t other = collisions[i].index[j];
+            if (j > 0 && collisions[i].index[j - 1] == other)
+            {
+                ++_collisionRuns.back().last;
+                continue;
+            }
+
+            collisionRun run;
+            run.plate = i;
+            run.first = j;
+            run.last = j + 1;
+            run.round = std::max(_plateRounds[i], _plateRounds[other]);
+            _plateRounds[i] = _plateRounds[other] = run.round + 1;
+            num_rounds = std::max(num_rounds, run.round + 1);
+            _collisionRuns.push_back(run);
+        }
+
+    // Sort the runs by round, keeping their order within each round.
+    _roundStarts.assign(num_rounds + 1, 0);
+    for (size_t k = 0; k < _collisionRuns.size(); ++k)
+        ++_roundStarts[_collisionRuns[k].round + 1];
+    for (size_t r = 0; r < num_rounds; ++r)
+        _roundStarts[r + 1] += _roundStarts[r];
+    _sortedRuns.resize(_collisionRuns.size());
+    _plateRounds.assign(_roundStarts.begin(), _roundStarts.end() - 1);
+    for (size_t k = 0; k < _collisionRuns.size(); ++k)
+        _sortedRuns[_plateRounds[_collisionRuns[k].round]++] = _collisionRuns[k];
+    _collisionRuns.swap(_sortedRuns);
+}
+
+void lithosphere::coalesceCollisions(size_t i)
+{
+    // A continent usually touches another plate at hundreds of pixels, and
+    // each of them would apply friction and test for aggregation again,
+    // although only the first aggregation moves any crust. Keep the first
+    // collision of each pair of plate and continent instead, carrying the
+    // crust of all of them.
+    collisionList& list = collisions[i];
+    _collisionGroups.clear();
+    size_t groups = 0;
+    for (size_t j = 0; j < list.size(); ++j)
+    {
+        const plateCollision coll = getCollision(list, j);
+        const size_t seg = plates[i]->getContinentAt(coll.wx, coll.wy);
+
+        // Plate indices are below num_plates, so the key is unique.
+        const size_t key = seg * num_plates + coll.index;
+        const std::pair<std::unordered_map<size_t, size_t>::iterator, bool>
+            group = _collisionGroups.insert(std::make_pair(key, groups));
+
+        if (!group.second)
+            list.crust[group.first->second] += coll.crust;
+        else
+        {
+            list.index[groups] = list.index[j];
+            list.location[groups] = list.location[j];
+            list.crust[groups] = list.crust[j];
+            ++groups;
+        }
+    }
+    list.truncate(groups);
+}
+
 void lithosphere::restart()
 {
 try {
@@ -752,10 +1573,8 @@ try {
       }
     }
 
-    // Delete plates.
-    delete[] plates;
-    plates = 0;
-    num_plates = 0;
+    // Retire plates. Their buffers are reused by the next population.
+    releasePlates();
 
     // create new plates IFF there are cycles left to run!
     // However, if max cycle count is "ETERNITY", then 0 < 0 + 1 always.
@@ -775,6 +1594,7 @@ try {
           const size_t* this_age_const;
           size_t* this_age;
 
+          plates[i]->unshare();
           plates[i]->getMap(&this_map, &this_age_const);
           this_age = (size_t *)this_age_const;
 
@@ -794,15 +1614,9 @@ try {
     }
 
     // Add some "virginity buoyancy" to all pixels for a visual boost.
-    for (size_t i = 0; i < (BUOYANCY_BONUS_X > 0) * map_area; ++i)
-    {
-        size_t crust_age = iter_count - amap[i];
-        crust_age = MAX_BUOYANCY_AGE - crust_age;
-        crust_age &= -(crust_age <= MAX_BUOYANCY_AGE);
-
-        hmap[i] += (hmap[i] < CONTINENTAL_BASE) * BUOYANCY_BONUS_X *
-                   OCEANIC_BASE * crust_age * MULINV_MAX_BUOYANCY_AGE;
-    }
+    if (BUOYANCY_BONUS_X > 0)
+        addBuoyancy(hmap.raw_data(), amap.raw_data(), map_area, iter_count,
+            MAX_BUOYANCY_AGE, BUOYANCY_BONUS_X * OCEANIC_BASE, CONTINENTAL_BASE);
 
     ///////////////////////////////////////////////////////////////////////
     // This is the LAST cycle! ////////////////////////////////////////////
@@ -1015,5 +1829,7 @@ size_t lithosphere::getHeight() const
 
 size_t* lithosphere::getPlatesMap() const throw()
 {
+    if (_stepper && _stepper->isBusy())
+        return _stepper->getPlatesMap();
     return imap;
 }
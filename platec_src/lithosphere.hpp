@@ -21,22 +21,31 @@
 
 #include <cstring> // For size_t.
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 #ifdef __MINGW32__ // this is to avoid a problem with the hypot function which is messed up by Python...
 #undef __STRICT_ANSI__
 #endif
 #include <cmath>
 #include "heightmap.hpp"
+#include "publisher.hpp"
 #include "rectangle.hpp"
 #include "simplerandom.hpp"
+#include "threadpool.hpp"
 
 using namespace std;
 
 #define CONTINENTAL_BASE 1.0f
 #define OCEANIC_BASE     0.1f
 
+class asyncStepper;
+class frameRecorder;
 class plate;
 
+namespace Checkpoint {
+class Reader;
+}
+
 /**
  * Lithosphere is the rigid outermost shell of a rocky planet.
  *
@@ -61,6 +70,23 @@ class lithosphere
 	 * @param aggr_ratio_abs # of overlapping points causing aggregation.
 	 * @param aggr_ratio_rel % of overlapping area causing aggregation.
 	 * @param num_cycles Number of times system will be restarted.
+	 * @param num_threads Number of threads used by the simulation. One
+	 *                    keeps everything on the calling thread, zero
+	 *                    shares a process-wide pool between all systems.
+	 * @param noise_tolerance Relative amplitude of the noise octaves that
+	 *                        may be skipped when creating the initial
+	 *                        height map. Zero computes all of them and
+	 *                        gives the same worlds as earlier versions.
+	 * @param parallel_growth Grow the plates from their origins on all
+	 *                        threads. Plates get similar irregular shapes,
+	 *                        but not the ones earlier versions gave.
+	 * @param coalesce_collisions Handle the continental collisions of each
+	 *                            step once per pair of plates and continent
+	 *                            instead of once per pixel. Gives slightly
+	 *                            different worlds than earlier versions.
+	 * @param classic_noise Make diamond-square noise with the padded
+	 *                      sqrdmd() of earlier versions instead of
+	 *                      sqrdmd_parallel().
 	 * @exception	invalid_argument Exception is thrown if map side length
 	 *           	is not a power of two and greater than three.
 	 */
@@ -69,10 +95,95 @@ class lithosphere
 		float sea_level,
 		size_t _erosion_period, float _folding_ratio,
 		size_t aggr_ratio_abs, float aggr_ratio_rel,
-		size_t num_cycles) throw(std::invalid_argument);
+		size_t num_cycles, size_t num_threads = 1,
+		float noise_tolerance = 0.0f,
+		bool parallel_growth = false,
+		bool coalesce_collisions = false,
+		bool classic_noise = false) throw(std::invalid_argument);
 
 	~lithosphere() throw(); ///< Standard destructor.
 
+	/**
+	 * Restore a system written by save().
+	 *
+	 * The restored system continues exactly like the saved one would
+	 * have, whatever the number of threads of either.
+	 *
+	 * @param path Name of the checkpoint file.
+	 * @param num_threads Number of threads, as in the constructor.
+	 * @return A new system owned by the caller.
+	 * @exception	runtime_error Exception is thrown if the file can't be
+	 *           	read or isn't a valid checkpoint.
+	 */
+	static lithosphere* load(const char* path, size_t num_threads = 1);
+
+	/**
+	 * Write the complete state of the system into a checkpoint file.
+	 *
+	 * The file is written under a temporary name first, so an existing
+	 * checkpoint of the same name survives a crash during the write.
+	 *
+	 * @param path Name of the checkpoint file.
+	 * @exception	runtime_error Exception is thrown if the file can't be
+	 *           	written.
+	 */
+	void save(const char* path) const;
+
+	/**
+	 * Append the maps after every Nth step to a file, see frameRecorder.
+	 *
+	 * Frames are written on a thread of their own, so recording adds
+	 * little more than a copy of the maps to the steps it records. An
+	 * earlier recording is stopped first.
+	 *
+	 * @param path Name of the recording file.
+	 * @param interval Record the steps whose number is a multiple of this.
+	 * @exception	runtime_error Exception is thrown if the file can't be
+	 *           	created or an earlier recording couldn't be written.
+	 */
+	void startRecording(const char* path, size_t interval);
+
+	/// Write the remaining frames and close the recording, if any.
+	/// @exception runtime_error Thrown if any frame couldn't be written.
+	void stopRecording();
+
+	/**
+	 * Publish the maps after every step for readers on other threads.
+	 *
+	 * The current maps are published at once. Readers take the latest
+	 * frame with acquireFrame() while the system keeps simulating.
+	 */
+	void startPublishing();
+
+	/// Take the latest published frame, or NULL if publishing hasn't
+	/// started. Any thread may call this at any time, and the frame stays
+	/// unchanged until it's given to releaseFrame(). Frames must be
+	/// released before the system is destroyed.
+	const publishedFrame* acquireFrame() const { return _publisher.acquire(); }
+	static void releaseFrame(const publishedFrame* frame)
+	{
+		framePublisher::release(frame);
+	}
+
+	/**
+	 * Branch off a copy of the system that continues with other settings.
+	 *
+	 * The copy shares the plates' maps with this system. A plate's maps are
+	 * only copied once either system changes that plate's crust, so plates
+	 * that only move keep sharing them.
+	 * With the same settings the copy continues exactly like this one.
+	 *
+	 * @param _erosion_period # of iterations between global erosion.
+	 * @param _folding_ratio Percent of overlapping crust that's folded.
+	 * @param aggr_ratio_abs # of overlapping points causing aggregation.
+	 * @param aggr_ratio_rel % of overlapping area causing aggregation.
+	 * @param num_threads Number of threads, as in the constructor.
+	 * @return A new system owned by the caller.
+	 */
+	lithosphere* fork(size_t _erosion_period, float _folding_ratio,
+		size_t aggr_ratio_abs, float aggr_ratio_rel,
+		size_t num_threads = 1) const;
+
 	/**
 	 * Split the current topography into given number of (rigid) plates.
 	 *
@@ -90,6 +201,22 @@ class lithosphere
 	float* getTopography() const throw(); ///< Return height map.
 	size_t* getPlatesMap() const throw(); ///< Return a map of the plates owning eaach point
 	void update(); ///< Simulate one step of plate tectonics.	
+
+	/**
+	 * Queue a step to be simulated on a thread of the system's own.
+	 *
+	 * Until wait() is called, the getters above return a snapshot of the
+	 * maps after the latest finished step instead of the live maps, see
+	 * asyncStepper. Nothing else may be called before wait().
+	 *
+	 * @param max_queued Wait while this many steps are queued already.
+	 * @exception Rethrows the exception of an earlier step that failed.
+	 */
+	void stepAsync(size_t max_queued = 1);
+
+	/// Wait for the steps queued by stepAsync() to finish.
+	/// @exception Rethrows the exception of a step that failed.
+	void wait();
 	size_t getWidth() const;
 	size_t getHeight() const;
 	bool isFinished() const;
@@ -97,6 +224,12 @@ class lithosphere
   protected:
   private:
 
+  	/// Create an empty system to be filled by restore().
+  	lithosphere(const WorldDimension& dim, size_t num_threads,
+  	            float noise_tolerance, bool parallel_growth,
+  	            bool coalesce_collisions, bool classic_noise);
+  	void restore(Checkpoint::Reader& in); ///< Read the rest of load().
+
   	void createNoise(float* tmp, const WorldDimension& tmpDim, bool useSimplex = false);
 
 	/**
@@ -126,12 +259,66 @@ class lithosphere
 		float crust; ///< Amount of crust that will deform/subduct.
 	};
 
+	/**
+	 * Collisions recorded to one plate during a step.
+	 *
+	 * Each field has an array of its own, of the smallest type that holds
+	 * it: ten bytes per collision instead of the 32 of a plateCollision.
+	 * Cleared arrays keep their capacity for the next step.
+	 */
+	class collisionList
+	{
+	  public:
+
+		void reserve(size_t n)
+		{
+			index.reserve(n);
+			location.reserve(n);
+			crust.reserve(n);
+		}
+
+		/// @param other Index of the other plate, less than 2^16.
+		/// @param k Index of the location on the world map, less than 2^32.
+		void push(size_t other, size_t k, float z)
+		{
+			index.push_back((uint16_t)other);
+			location.push_back((uint32_t)k);
+			crust.push_back(z);
+		}
+
+		void truncate(size_t n) ///< Drop all collisions from n on.
+		{
+			index.resize(n);
+			location.resize(n);
+			crust.resize(n);
+		}
+
+		void clear() throw() { truncate(0); }
+		size_t size() const throw() { return crust.size(); }
+
+		std::vector<uint16_t> index; ///< Other plate involved.
+		std::vector<uint32_t> location; ///< Index on the world map.
+		std::vector<float> crust; ///< Crust that will deform/subduct.
+	};
+
+	/// Unpack the jth collision of a list.
+	plateCollision getCollision(const collisionList& list, size_t j) const;
+
 	void restart(); //< Replace plates with a new population.
+	void coalesceCollisions(size_t i); ///< Merge collisions[i] by continent.
+	void scheduleCollisions(); ///< Order collisions into parallel rounds.
+
+	/// Apply friction to both plates of a continental collision and let
+	/// the smaller one's continent join the other plate if they overlap
+	/// enough. Touches no other plates.
+	void processCollision(size_t i, const plateCollision& coll);
+	void stepFinished(); ///< Record and publish the maps of a step.
+	void releasePlates(); ///< Move all plates to the pool.
 
 	HeightMap hmap; ///< Height map representing the topography of system.
 	size_t* imap; ///< Plate index map of the "owner" of each map point.
 	AgeMap amap; ///< Age map of the system's surface (topography).
-	plate** plates; ///< Array of plates that constitute the system.
+	std::vector<plate*> plates; ///< Array of plates that constitute the system.
 
 	size_t aggr_overlap_abs; ///< # of overlapping pixels -> aggregation.
 	float  aggr_overlap_rel; ///< % of overlapping area -> aggregation.
@@ -143,8 +330,25 @@ class lithosphere
 	size_t max_plates; ///< Number of plates in the initial setting.
 	size_t num_plates; ///< Number of plates in the current setting.
 
-	std::vector<std::vector<plateCollision> > collisions;
-	std::vector<std::vector<plateCollision> > subductions;
+	std::vector<collisionList> collisions;
+	std::vector<collisionList> subductions;
+	std::vector<std::vector<uint32_t> > _divergentPixels; ///< New crust per plate.
+	/// Scratch of coalesceCollisions: group of each plate and continent.
+	std::unordered_map<size_t, size_t> _collisionGroups;
+
+	/// Consecutive collisions of one plate with the same other plate.
+	class collisionRun
+	{
+	  public:
+		size_t plate; ///< Index of the list in collisions.
+		size_t first, last; ///< Range of the run in the list.
+		size_t round; ///< Runs of earlier rounds must finish first.
+	};
+
+	std::vector<collisionRun> _collisionRuns; ///< Sorted by round.
+	std::vector<collisionRun> _sortedRuns; ///< Scratch of scheduleCollisions.
+	std::vector<size_t> _roundStarts; ///< First run of each round, and end.
+	std::vector<size_t> _plateRounds; ///< Scratch of scheduleCollisions.
 
 	float peak_Ek; ///< Max total kinetic energy in the system so far.
 	size_t last_coll_count; ///< Iterations since last cont. collision.
@@ -152,6 +356,22 @@ class lithosphere
 	const WorldDimension _worldDimension;
 	SimpleRandom _randsource;
 	int _steps;
+
+	std::vector<plate*> _platePool; ///< Discarded plates kept for reuse.
+	std::vector<float> _plateBuffer; ///< Scratch map for creating plates.
+
+	Platec::ThreadPool* _threadPool; ///< Executes parallel work.
+	bool _ownsThreadPool; ///< False if the pool is the process-wide one.
+	const float _noiseTolerance; ///< Octave tolerance of simplex noise.
+	const bool _parallelGrowth; ///< Grow plates on the thread pool.
+	const bool _coalesceCollisions; ///< Collide once per continent pair.
+	const bool _classicNoise; ///< Use the padded sqrdmd() for noise.
+	frameRecorder* _recorder; ///< Recording of the steps, if any.
+	asyncStepper* _stepper; ///< Runs queued steps, once there have been any.
+	framePublisher _publisher; ///< Latest maps for other threads.
+	bool _publishing; ///< Publish the maps after each step.
+
+	friend class asyncStepper;
 };
 
 
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <string>
 #include "noise.hpp"
 #include "sqrdmd.hpp"
@@ -17,65 +18,82 @@ static uint32_t nearest_pow(uint32_t num)
     return n;
 }
 
-void createNoise(float* tmp, const WorldDimension& tmpDim, SimpleRandom randsource, bool useSimplex)
+/// Run the classic sqrdmd() on a square padded around the map and blend
+/// mirrored copies of the result to make it roughly tileable.
+static void classicSqrdmd(long seed, float* tmp, const WorldDimension& tmpDim)
 {
-try {
-    if (useSimplex) {
-        simplexnoise(randsource.next(), tmp, 
-            tmpDim.getWidth(), 
-            tmpDim.getHeight(), 
-            SQRDMD_ROUGHNESS);
-    } else {        
-        size_t side = tmpDim.getMax();
-        side = nearest_pow(side)+1;
-        float* squareTmp = new float[side*side];
-        memset(squareTmp, 0, sizeof(float)*side*side);
-        for (int y=0; y<tmpDim.getHeight(); y++){
-            memcpy(&squareTmp[y*side],&tmp[y*tmpDim.getWidth()],sizeof(float)*tmpDim.getWidth());
+    size_t side = tmpDim.getMax();
+    side = nearest_pow(side)+1;
+    float* squareTmp = new float[side*side];
+    memset(squareTmp, 0, sizeof(float)*side*side);
+    for (size_t y=0; y<tmpDim.getHeight(); y++){
+        memcpy(&squareTmp[y*side],&tmp[y*tmpDim.getWidth()],sizeof(float)*tmpDim.getWidth());
+    }
+    // to make it tileable we need to insert proper values in the padding area
+    // 1) on the right of the valid area
+    for (size_t y=0; y<tmpDim.getHeight(); y++){
+        for (size_t x=tmpDim.getWidth(); x<side; x++){
+            // we simply put it as a mix between the east and west border (they should be fairly
+            // similar because it is a toroidal world)
+            squareTmp[y*side+x] = (squareTmp[y*side+0] + squareTmp[y*side+(tmpDim.getWidth()-1)])/2;
         }
-        // to make it tileable we need to insert proper values in the padding area
-        // 1) on the right of the valid area        
-        for (int y=0; y<tmpDim.getHeight(); y++){
-        	for (int x=tmpDim.getWidth(); x<side; x++){
-        		// we simply put it as a mix between the east and west border (they should be fairly
-        		// similar because it is a toroidal world)
-        		squareTmp[y*side+x] = (squareTmp[y*side+0] + squareTmp[y*side+(tmpDim.getWidth()-1)])/2;
-        	}
+    }
+    // 2) below the valid area
+    for (size_t y=tmpDim.getHeight(); y<side; y++){
+        for (size_t x=0; x<side; x++){
+            // we simply put it as a mix between the north and south border (they should be fairly
+            // similar because it is a toroidal world)
+            squareTmp[y*side+x] = (squareTmp[(0)*side+x] + squareTmp[(tmpDim.getHeight()-1)*side+x])/2;
         }
-        // 2) below the valid area
-        for (int y=tmpDim.getHeight(); y<side; y++){
-        	for (int x=0; x<side; x++){
-        		// we simply put it as a mix between the north and south border (they should be fairly
-        		// similar because it is a toroidal world)
-        		squareTmp[y*side+x] = (squareTmp[(0)*side+x] + squareTmp[(tmpDim.getHeight()-1)*side+x])/2;
-        	}
-        }        
+    }
 
-        sqrdmd(randsource.next(), squareTmp, side, SQRDMD_ROUGHNESS);
+    sqrdmd(seed, squareTmp, side, SQRDMD_ROUGHNESS);
 
-        // Calcuate deltas (noise introduced)
-        float* deltas = new float[tmpDim.getWidth()*tmpDim.getHeight()];
-        for (int y=0; y<tmpDim.getHeight(); y++){
-        	for (int x=0; x<tmpDim.getWidth(); x++){
-        		deltas[y*tmpDim.getWidth()+x] = squareTmp[y*side+x]-tmp[y*tmpDim.getWidth()+x];
-        	}
+    // Calcuate deltas (noise introduced)
+    float* deltas = new float[tmpDim.getWidth()*tmpDim.getHeight()];
+    for (size_t y=0; y<tmpDim.getHeight(); y++){
+        for (size_t x=0; x<tmpDim.getWidth(); x++){
+            deltas[y*tmpDim.getWidth()+x] = squareTmp[y*side+x]-tmp[y*tmpDim.getWidth()+x];
         }
+    }
 
-        // make it tileable
-        for (int y=0; y<tmpDim.getHeight(); y++){
-        	for (int x=0; x<tmpDim.getWidth(); x++){
-        		int specularX = tmpDim.getWidth() - 1 - x;
-        		int specularY = tmpDim.getHeight() -1 - y;
-        		float myDelta = deltas[y*tmpDim.getWidth()+x];
-        		float specularWidthDelta = deltas[y*tmpDim.getWidth()+specularX];
-        		float specularHeightDelta = deltas[specularY*tmpDim.getWidth()+x];
-        		float oppositeDelta = deltas[specularY*tmpDim.getWidth()+specularX];
-        		tmp[y*tmpDim.getWidth()+x] += (myDelta + specularWidthDelta + specularHeightDelta + oppositeDelta)/4;
-        	}
+    // make it tileable
+    for (size_t y=0; y<tmpDim.getHeight(); y++){
+        for (size_t x=0; x<tmpDim.getWidth(); x++){
+            size_t specularX = tmpDim.getWidth() - 1 - x;
+            size_t specularY = tmpDim.getHeight() -1 - y;
+            float myDelta = deltas[y*tmpDim.getWidth()+x];
+            float specularWidthDelta = deltas[y*tmpDim.getWidth()+specularX];
+            float specularHeightDelta = deltas[specularY*tmpDim.getWidth()+x];
+            float oppositeDelta = deltas[specularY*tmpDim.getWidth()+specularX];
+            tmp[y*tmpDim.getWidth()+x] += (myDelta + specularWidthDelta + specularHeightDelta + oppositeDelta)/4;
         }
-       
-        delete[] squareTmp;
-    }    
+    }
+
+    delete[] deltas;
+    delete[] squareTmp;
+}
+
+void createNoise(float* tmp, const WorldDimension& tmpDim, SimpleRandom randsource, bool useSimplex,
+                 Platec::ThreadPool* pool, float tolerance, bool classic)
+{
+try {
+    if (useSimplex) {
+        simplexnoise(randsource.next(), tmp, 
+            tmpDim.getWidth(), 
+            tmpDim.getHeight(), 
+            SQRDMD_ROUGHNESS,
+            pool,
+            tolerance);
+    } else if (classic) {
+        classicSqrdmd(randsource.next(), tmp, tmpDim);
+    } else {
+        sqrdmd_parallel(randsource.next(), tmp,
+            tmpDim.getWidth(),
+            tmpDim.getHeight(),
+            SQRDMD_ROUGHNESS,
+            pool);
+    }
 } catch (const exception& e){
     std::string msg = "Problem during lithosphere::createNoise, tmpDim+=";
     msg = msg + Platec::to_string(tmpDim.getWidth()) + "x" + Platec::to_string(tmpDim.getHeight()) + " ";
@@ -7,6 +7,13 @@
 #include "rectangle.hpp"
 #include "simplerandom.hpp"
 
-void createNoise(float* tmp, const WorldDimension& tmpDim, SimpleRandom _randsource, bool useSimplex = false);
+namespace Platec { class ThreadPool; }
+
+/// Fill tmp with simplex or diamond-square noise. Diamond-square noise is
+/// made by sqrdmd_parallel(), or with classic by the padded sqrdmd() of
+/// earlier versions, which gives their maps for the same seed.
+void createNoise(float* tmp, const WorldDimension& tmpDim, SimpleRandom _randsource, bool useSimplex = false,
+                 Platec::ThreadPool* pool = NULL, float tolerance = 0.0f,
+                 bool classic = false);
 
 #endif
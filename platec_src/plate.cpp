@@ -21,6 +21,7 @@
 #ifdef __MINGW32__ // this is to avoid a problem with the hypot function which is messed up by Python...
 #undef __STRICT_ANSI__
 #endif
+#include <algorithm> // min
 #include <cmath>     // sin, cos
 #include <cstdlib>   // rand
 #include <vector>
@@ -28,6 +29,7 @@
 #include <assert.h>
 
 #include "plate.hpp"
+#include "checkpoint.hpp"
 #include "heightmap.hpp"
 #include "rectangle.hpp"
 #include "utils.hpp"
@@ -42,25 +44,52 @@ plate::plate(long seed, const float* m, size_t w, size_t h, size_t _x, size_t _y
              _randsource(seed),
              width(w), height(h),
              mass(0), left(_x), top(_y), cx(0), cy(0), dx(0), dy(0),
-             map(w, h), age_map(w, h), _worldDimension(worldDimension)
+             map(w, h), age_map(w, h), _worldDimension(worldDimension),
+             segment(NULL), segment_capacity(0), _sharesSegments(false)
+{
+    init(m, plate_age);
+}
+
+void plate::reset(long seed, const float* m, size_t w, size_t h,
+                  size_t _x, size_t _y, size_t plate_age)
+{
+    _randsource.seed(seed);
+    map.resize(w, h);
+    age_map.resize(w, h);
+
+    width = w;
+    height = h;
+    mass = 0;
+    left = _x;
+    top = _y;
+    cx = cy = 0;
+    dx = dy = 0;
+    seg_data.clear();
+
+    init(m, plate_age);
+}
+
+void plate::init(const float* m, size_t plate_age)
 {
     if (NULL == m) {
         throw invalid_argument("the given heightmap should not be null");
     }
-    if (w <= 0 || h <= 0) {
+    if (width <= 0 || height <= 0) {
         throw invalid_argument("width and height of the plate should be greater than zero");
     }
-    if (_x < 0 || _y <0) {
+    if (left < 0 || top < 0) {
         throw invalid_argument("coordinates of the plate should be greater or equal to zero");
     }
     if (plate_age < 0) {
         throw invalid_argument("age of the plate should be greater or equal to zero");
     }
 
-    const size_t plate_area = w * h;
+    const size_t plate_area = width * height;
     const double angle = 2 * M_PI * _randsource.next_double();
 
-    segment = new size_t[plate_area];
+    if (plate_area > segment_capacity || _sharesSegments) {
+        allocateSegments(plate_area);
+    }
 
     velocity = 1;
     rot_dir = _randsource.next() & 1 ? 1 : -1;
@@ -92,10 +121,113 @@ plate::plate(long seed, const float* m, size_t w, size_t h, size_t _x, size_t _y
     cy /= mass;
 }
 
+plate::plate(const plate& other) :
+             _randsource(other._randsource),
+             map(1, 1), age_map(1, 1),
+             width(other.width), height(other.height),
+             _worldDimension(other._worldDimension),
+             mass(other.mass), left(other.left), top(other.top),
+             cx(other.cx), cy(other.cy), velocity(other.velocity),
+             vx(other.vx), vy(other.vy), dx(other.dx), dy(other.dy),
+             rot_dir(other.rot_dir), seg_data(other.seg_data),
+             segment(other.segment),
+             segment_capacity(other.segment_capacity),
+             _segmentBuffer(other._segmentBuffer), _sharesSegments(true)
+{
+    other._sharesSegments = true;
+    map.share(other.map);
+    age_map.share(other.age_map);
+}
+
 plate::~plate() throw()
 {
-    delete[] segment;
-    segment = NULL;
+}
+
+void plate::allocateSegments(size_t capacity)
+{
+    _segmentBuffer.reset(new ContinentId[capacity],
+        std::default_delete<ContinentId[]>());
+    segment = _segmentBuffer.get();
+    segment_capacity = capacity;
+    _sharesSegments = false;
+}
+
+plate::plate(Checkpoint::Reader& in, WorldDimension worldDimension) :
+             _randsource(0), map(1, 1), age_map(1, 1), width(0), height(0),
+             _worldDimension(worldDimension), segment(NULL),
+             segment_capacity(0), _sharesSegments(false)
+{
+    _randsource.setState(in.getU32());
+    width = in.getSize();
+    height = in.getSize();
+    if (width == 0 || height == 0 ||
+        width > _worldDimension.getWidth() ||
+        height > _worldDimension.getHeight())
+        throw runtime_error("invalid plate size in checkpoint");
+
+    mass = in.getFloat();
+    left = in.getFloat();
+    top = in.getFloat();
+    cx = in.getFloat();
+    cy = in.getFloat();
+    velocity = in.getFloat();
+    vx = in.getFloat();
+    vy = in.getFloat();
+    dx = in.getFloat();
+    dy = in.getFloat();
+    rot_dir = in.getFloat();
+
+    const size_t plate_area = width * height;
+    map.resize(width, height);
+    age_map.resize(width, height);
+    allocateSegments(plate_area);
+    in.getFloats(map.raw_data(), plate_area);
+    in.getSizes(age_map.raw_data(), plate_area);
+    in.getSizes(segment, plate_area);
+
+    const size_t segments = in.getSize();
+    for (size_t i = 0; i < segments; ++i)
+    {
+        const size_t lft = in.getSize(), rgt = in.getSize();
+        const size_t top = in.getSize(), btm = in.getSize();
+        Platec::Rectangle r(_worldDimension, lft, rgt, top, btm);
+        seg_data.push_back(segmentData(r, in.getSize()));
+        seg_data.back().coll_count = in.getSize();
+    }
+}
+
+void plate::save(Checkpoint::Writer& out) const
+{
+    out.putU32(_randsource.getState());
+    out.putSize(width);
+    out.putSize(height);
+    out.putFloat(mass);
+    out.putFloat(left);
+    out.putFloat(top);
+    out.putFloat(cx);
+    out.putFloat(cy);
+    out.putFloat(velocity);
+    out.putFloat(vx);
+    out.putFloat(vy);
+    out.putFloat(dx);
+    out.putFloat(dy);
+    out.putFloat(rot_dir);
+
+    const size_t plate_area = width * height;
+    out.putFloats(map.raw_data(), plate_area);
+    out.putSizes(age_map.raw_data(), plate_area);
+    out.putSizes(segment, plate_area);
+
+    out.putSize(seg_data.size());
+    for (size_t i = 0; i < seg_data.size(); ++i)
+    {
+        out.putSize(seg_data[i].getLeft());
+        out.putSize(seg_data[i].getRight());
+        out.putSize(seg_data[i].getTop());
+        out.putSize(seg_data[i].getBottom());
+        out.putSize(seg_data[i].area);
+        out.putSize(seg_data[i].coll_count);
+    }
 }
 
 size_t plate::addCollision(size_t wx, size_t wy)
@@ -165,6 +297,8 @@ void plate::addCrustBySubduction(size_t x, size_t y, float z, size_t t,
     index = y * width + x;
     if (index < width * height && map[index] > 0)
     {
+        unshare();
+
         t = (map[index] * age_map[index] + z * t) / (map[index] + z);
         age_map[index] = t * (z > 0);
 
@@ -201,6 +335,7 @@ try {
     }
 
     ContinentId activeContinent = p->selectCollisionSegment(wx, wy);
+    unshare();
 
     // Wrap coordinates around world edges to safeguard subtractions.
     wx += _worldDimension.getWidth();
@@ -440,6 +575,8 @@ try {
 void plate::erode(float lower_bound)
 {
 try {    
+  unshare();
+
   vector<size_t> sources_data;
   vector<size_t> sinks_data;
   vector<size_t>* sources = &sources_data;
@@ -542,10 +679,16 @@ try {
   delete[] isDone;
 
   // Add random noise (10 %) to heightmap.
-  for (size_t i = 0; i < width*height; ++i)
+  float noise[1024];
+  for (size_t i = 0; i < width*height; i += 1024)
   {
-    float alpha = 0.2 * (float)_randsource.next_double();
-    tmp[i] += 0.1 * tmp[i] - alpha * tmp[i];
+    const size_t count = std::min<size_t>(1024, width*height - i);
+    _randsource.fill(noise, count);
+    for (size_t j = 0; j < count; ++j)
+    {
+      float alpha = 0.2 * noise[j];
+      tmp[i+j] += 0.1 * tmp[i+j] - alpha * tmp[i+j];
+    }
   }
 
   memcpy(map.raw_data(), tmp, width*height*sizeof(float));
@@ -656,6 +799,7 @@ try {
     }
 
   map.from(tmp);
+  delete[] tmp;
 
   if (mass > 0)
   {
@@ -766,6 +910,9 @@ try {
 
 void plate::resetSegments()
 {
+    // No need to copy shared IDs that would be cleared anyway.
+    if (_sharesSegments)
+        allocateSegments(segment_capacity);
     memset(segment, -1, sizeof(size_t) * width * height);
     seg_data.clear();
 }
@@ -786,108 +933,61 @@ try {
         // Extending plate for nothing!
         assert(z>0);
 
-        const size_t ilft = left;
-        const size_t itop = top;
-        const size_t irgt = ilft + width - 1;
-        const size_t ibtm = itop + height - 1;
-
-        _worldDimension.normalize(x, y);
-
-        // Calculate distance of new point from plate edges.
-        const size_t _lft = ilft - x;
-        const size_t _rgt = (_worldDimension.getWidth() & -(x < ilft)) + x - irgt;
-        const size_t _top = itop - y;
-        const size_t _btm = (_worldDimension.getHeight() & -(y < itop)) + y - ibtm;
-
-        // Set larger of horizontal/vertical distance to zero.
-        // A valid distance is NEVER larger than world's side's length!
-        size_t d_lft = _lft & -(_lft <  _rgt) & -(_lft < _worldDimension.getWidth());
-        size_t d_rgt = _rgt & -(_rgt <= _lft) & -(_rgt < _worldDimension.getWidth());
-        size_t d_top = _top & -(_top <  _btm) & -(_top < _worldDimension.getHeight());
-        size_t d_btm = _btm & -(_btm <= _top) & -(_btm < _worldDimension.getHeight());
-
-        // Scale all changes to multiple of 8.
-        d_lft = ((d_lft > 0) + (d_lft >> 3)) << 3;
-        d_rgt = ((d_rgt > 0) + (d_rgt >> 3)) << 3;
-        d_top = ((d_top > 0) + (d_top >> 3)) << 3;
-        d_btm = ((d_btm > 0) + (d_btm >> 3)) << 3;
-
-        // Make sure plate doesn't grow bigger than the system it's in!
-        if (width + d_lft + d_rgt > _worldDimension.getWidth())
-        {
-            d_lft = 0;
-            d_rgt = _worldDimension.getWidth() - width;
-        }
+        mapBounds bounds = getBounds();
+        extendBounds(bounds, x, y);
+        resize(bounds);
 
-        if (height + d_top + d_btm > _worldDimension.getHeight())
-        {
-            d_top = 0;
-            d_btm = _worldDimension.getHeight() - height;
-        }
+        _x = x, _y = y;
+        index = getMapIndex(&_x, &_y);
 
-        // Index out of bounds, but nowhere to grow!
-        assert(d_lft + d_rgt + d_top + d_btm != 0);
-
-        const size_t old_width  = width;
-        const size_t old_height = height;
-        
-        left -= d_lft;
-        left += left >= 0 ? 0 : _worldDimension.getWidth();
-        width += d_lft + d_rgt;
-
-        top -= d_top;
-        top += top >= 0 ? 0 : _worldDimension.getHeight();
-        height += d_top + d_btm;
-
-        HeightMap tmph = HeightMap(width, height);
-        AgeMap    tmpa = AgeMap(width, height);
-        size_t* tmps = new size_t[width*height];
-        tmph.set_all(0);
-        tmpa.set_all(0);
-        memset(tmps, 255, width*height*sizeof(size_t));
-
-        // copy old plate into new.
-        for (size_t j = 0; j < old_height; ++j)
-        {
-            const size_t dest_i = (d_top + j) * width + d_lft;
-            const size_t src_i = j * old_width;
-            memcpy(&tmph[dest_i], &map[src_i], old_width *
-                sizeof(float));
-            memcpy(&tmpa[dest_i], &age_map[src_i], old_width *
-                sizeof(size_t));
-            memcpy(&tmps[dest_i], &segment[src_i], old_width *
-                sizeof(size_t));
-        }
+        assert(index < width * height);
+    }
 
-        delete[] segment;
-        map     = tmph;
-        age_map = tmpa;
-        segment = tmps;
+    unshare();
+    setCrustAt(index, z, t);
+} catch (const exception& e){
+    std::string msg = "Problem during plate::setCrust: ";
+    msg = msg + e.what();
+    throw runtime_error(msg.c_str());
+}
+}
 
-        // Shift all segment data to match new coordinates.
-        for (size_t s = 0; s < seg_data.size(); ++s)
+void plate::setCrust(const uint32_t* locations, size_t count, float z,
+    size_t t)
+{
+try {
+    if (z < 0) { // Do not accept negative values.
+        z = 0;
+    }
+
+    // Grow the bounds exactly as setting the locations one by one would,
+    // but move the maps only once.
+    const size_t world_width = _worldDimension.getWidth();
+    mapBounds bounds = getBounds();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t x = locations[i] % world_width;
+        const size_t y = locations[i] / world_width;
+        size_t _x = x, _y = y;
+        if (getMapIndex(bounds, &_x, &_y) >= bounds.width * bounds.height)
         {
-            seg_data[s].shift(d_lft, d_top);
+            assert(z>0);
+            extendBounds(bounds, x, y);
         }
+    }
+    if (bounds.width != width || bounds.height != height)
+        resize(bounds);
+    unshare();
 
-        _x = x, _y = y;
-        index = getMapIndex(&_x, &_y);
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t x = locations[i] % world_width;
+        size_t y = locations[i] / world_width;
+        const size_t index = getMapIndex(&x, &y);
 
         assert(index < width * height);
+        setCrustAt(index, z, t);
     }
-
-    // Update crust's age.
-    // If old crust exists, new age is mean of original and supplied ages.
-    // If no new crust is added, original time remains intact.
-    const size_t old_crust = -(map[index] > 0);
-    const size_t new_crust = -(z > 0);
-    t = (t & ~old_crust) | ((size_t)((map[index] * age_map[index] + z * t) /
-        (map[index] + z)) & old_crust);
-    age_map[index] = (t & new_crust) | (age_map[index] & ~new_crust);
-
-    mass -= map[index];
-    map[index] = z;     // Set new crust height to desired location.
-    mass += z;      // Update mass counter.
 } catch (const exception& e){
     std::string msg = "Problem during plate::setCrust: ";
     msg = msg + e.what();
@@ -895,6 +995,18 @@ try {
 }
 }
 
+void plate::unshare()
+{
+    map.unshare();
+    age_map.unshare();
+    if (_sharesSegments)
+    {
+        const std::shared_ptr<ContinentId> shared = _segmentBuffer;
+        allocateSegments(segment_capacity);
+        memcpy(segment, shared.get(), width * height * sizeof(ContinentId));
+    }
+}
+
 ContinentId plate::selectCollisionSegment(size_t coll_x, size_t coll_y)
 {
     size_t index = getMapIndex(&coll_x, &coll_y);
@@ -1132,6 +1244,133 @@ try {
 }
 }
 
+plate::mapBounds plate::getBounds() const throw()
+{
+    mapBounds bounds;
+    bounds.left = left;
+    bounds.top = top;
+    bounds.width = width;
+    bounds.height = height;
+    bounds.grown_x = 0;
+    bounds.grown_y = 0;
+    return bounds;
+}
+
+void plate::extendBounds(mapBounds& bounds, size_t x, size_t y) const
+{
+    const size_t ilft = bounds.left;
+    const size_t itop = bounds.top;
+    const size_t irgt = ilft + bounds.width - 1;
+    const size_t ibtm = itop + bounds.height - 1;
+
+    _worldDimension.normalize(x, y);
+
+    // Calculate distance of new point from plate edges.
+    const size_t _lft = ilft - x;
+    const size_t _rgt = (_worldDimension.getWidth() & -(x < ilft)) + x - irgt;
+    const size_t _top = itop - y;
+    const size_t _btm = (_worldDimension.getHeight() & -(y < itop)) + y - ibtm;
+
+    // Set larger of horizontal/vertical distance to zero.
+    // A valid distance is NEVER larger than world's side's length!
+    size_t d_lft = _lft & -(_lft <  _rgt) & -(_lft < _worldDimension.getWidth());
+    size_t d_rgt = _rgt & -(_rgt <= _lft) & -(_rgt < _worldDimension.getWidth());
+    size_t d_top = _top & -(_top <  _btm) & -(_top < _worldDimension.getHeight());
+    size_t d_btm = _btm & -(_btm <= _top) & -(_btm < _worldDimension.getHeight());
+
+    // Scale all changes to multiple of 8.
+    d_lft = ((d_lft > 0) + (d_lft >> 3)) << 3;
+    d_rgt = ((d_rgt > 0) + (d_rgt >> 3)) << 3;
+    d_top = ((d_top > 0) + (d_top >> 3)) << 3;
+    d_btm = ((d_btm > 0) + (d_btm >> 3)) << 3;
+
+    // Make sure plate doesn't grow bigger than the system it's in!
+    if (bounds.width + d_lft + d_rgt > _worldDimension.getWidth())
+    {
+        d_lft = 0;
+        d_rgt = _worldDimension.getWidth() - bounds.width;
+    }
+
+    if (bounds.height + d_top + d_btm > _worldDimension.getHeight())
+    {
+        d_top = 0;
+        d_btm = _worldDimension.getHeight() - bounds.height;
+    }
+
+    // Index out of bounds, but nowhere to grow!
+    assert(d_lft + d_rgt + d_top + d_btm != 0);
+
+    bounds.left -= d_lft;
+    bounds.left += bounds.left >= 0 ? 0 : _worldDimension.getWidth();
+    bounds.width += d_lft + d_rgt;
+    bounds.grown_x += d_lft;
+
+    bounds.top -= d_top;
+    bounds.top += bounds.top >= 0 ? 0 : _worldDimension.getHeight();
+    bounds.height += d_top + d_btm;
+    bounds.grown_y += d_top;
+}
+
+void plate::resize(const mapBounds& bounds)
+{
+    const size_t old_width  = width;
+    const size_t old_height = height;
+
+    left = bounds.left;
+    top = bounds.top;
+    width = bounds.width;
+    height = bounds.height;
+
+    HeightMap tmph = HeightMap(width, height);
+    AgeMap    tmpa = AgeMap(width, height);
+    size_t* tmps = new size_t[width*height];
+    tmph.set_all(0);
+    tmpa.set_all(0);
+    memset(tmps, 255, width*height*sizeof(size_t));
+
+    // copy old plate into new.
+    for (size_t j = 0; j < old_height; ++j)
+    {
+        const size_t dest_i = (bounds.grown_y + j) * width + bounds.grown_x;
+        const size_t src_i = j * old_width;
+        memcpy(&tmph[dest_i], &map[src_i], old_width *
+            sizeof(float));
+        memcpy(&tmpa[dest_i], &age_map[src_i], old_width *
+            sizeof(size_t));
+        memcpy(&tmps[dest_i], &segment[src_i], old_width *
+            sizeof(size_t));
+    }
+
+    map     = tmph;
+    age_map = tmpa;
+    _segmentBuffer.reset(tmps, std::default_delete<ContinentId[]>());
+    _sharesSegments = false;
+    segment = tmps;
+    segment_capacity = width * height;
+
+    // Shift all segment data to match new coordinates.
+    for (size_t s = 0; s < seg_data.size(); ++s)
+    {
+        seg_data[s].shift(bounds.grown_x, bounds.grown_y);
+    }
+}
+
+void plate::setCrustAt(size_t index, float z, size_t t)
+{
+    // Update crust's age.
+    // If old crust exists, new age is mean of original and supplied ages.
+    // If no new crust is added, original time remains intact.
+    const size_t old_crust = -(map[index] > 0);
+    const size_t new_crust = -(z > 0);
+    t = (t & ~old_crust) | ((size_t)((map[index] * age_map[index] + z * t) /
+        (map[index] + z)) & old_crust);
+    age_map[index] = (t & new_crust) | (age_map[index] & ~new_crust);
+
+    mass -= map[index];
+    map[index] = z;     // Set new crust height to desired location.
+    mass += z;      // Update mass counter.
+}
+
 size_t plate::getMapIndex(size_t* px, size_t* py) const throw()
 {
     const size_t ilft = (size_t)(int)left;
@@ -1143,6 +1382,18 @@ size_t plate::getMapIndex(size_t* px, size_t* py) const throw()
     return rect.getMapIndex(px, py);
 }
 
+size_t plate::getMapIndex(const mapBounds& bounds, size_t* px, size_t* py)
+    const throw()
+{
+    const size_t ilft = (size_t)(int)bounds.left;
+    const size_t itop = (size_t)(int)bounds.top;
+    const size_t irgt = ilft + bounds.width;
+    const size_t ibtm = itop + bounds.height;
+
+    Platec::Rectangle rect = Platec::Rectangle(_worldDimension, ilft, irgt, itop, ibtm);
+    return rect.getMapIndex(px, py);
+}
+
 ContinentId plate::getContinentAt(int x, int y) const
 {
     size_t lx = x, ly = y;
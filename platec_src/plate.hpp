@@ -20,6 +20,7 @@
 #define PLATE_HPP
 
 #include <cstring> // for size_t
+#include <memory>
 #include <vector>
 #include "simplerandom.hpp"
 #include "heightmap.hpp"
@@ -27,6 +28,11 @@
 
 #define CONT_BASE 1.0 ///< Height limit that separates seas from dry land.
 
+namespace Checkpoint {
+class Reader;
+class Writer;
+}
+
 typedef size_t ContinentId;
 
 class plate
@@ -44,8 +50,39 @@ class plate
 	plate(long seed, const float* m, size_t w, size_t h, size_t _x, size_t _y,
 	      size_t plate_age, WorldDimension worldDimension);
 
+	/// Restore a plate written by save().
+	///
+	/// @param	in	           Checkpoint positioned at the plate.
+	/// @param	worldDimension Dimension of world map's either side in pixels.
+	/// @exception	runtime_error Exception is thrown if the checkpoint
+	///           	can't be read.
+	plate(Checkpoint::Reader& in, WorldDimension worldDimension);
+
+	/// Copy a plate without copying its maps.
+	///
+	/// The copy shares the maps of the original until either of them
+	/// changes its crust, see unshare().
+	plate(const plate& other);
+
 	~plate() throw(); ///< Default destructor for plate.
 
+	/// Write the complete state of the plate into a checkpoint.
+	void save(Checkpoint::Writer& out) const;
+
+	/// Reinitializes plate with the supplied height map.
+	///
+	/// The result is the same as that of constructing a new plate of the
+	/// same world, but the plate's buffers are reused if they're large
+	/// enough.
+	///
+	/// @param	m	           Pointer to array to height map of terrain.
+	/// @param	w	           Width of height map in pixels.
+	/// @param	h	           Height of height map in pixels.
+	/// @param	_x	           X of height map's left-top corner on world map.
+	/// @param	_y	           Y of height map's left-top corner on world map.
+	void reset(long seed, const float* m, size_t w, size_t h, size_t _x,
+	           size_t _y, size_t plate_age);
+
 	/// Increment collision counter of the continent at given location.
 	///
 	/// @param	wx	X coordinate of collision point on world map.
@@ -135,6 +172,14 @@ class plate
 	void getCollisionInfo(size_t wx, size_t wy, size_t* count,
 	                        float* ratio) const;
 
+	/// Find the continent at given location, creating its segment if
+	/// it's not known yet.
+	///
+	/// @param	x	X coordinate of the location on world map.
+	/// @param	y	Y coordinate of the location on world map.
+	/// @return	Segment ID of the continent.
+	ContinentId getContinentAt(int x, int y) const;
+
 	/// Retrieve the surface area of continent lying at desired location.
 	///
 	/// @param	wx	X coordinate of collision point on world map.
@@ -195,6 +240,24 @@ class plate
 	/// @param	t	Time of creation of new crust.
 	void setCrust(size_t x, size_t y, float z, size_t t);
 
+	/// Set the same amount of crust at many locations.
+	///
+	/// Gives the same result as setting them one by one in the given
+	/// order, but moves the plate's maps at most once to make room.
+	///
+	/// @param	locations	Indices of the locations on the world map.
+	/// @param	count	Number of locations.
+	/// @param	z	Amount of crust at each location.
+	/// @param	t	Time of creation of new crust.
+	void setCrust(const uint32_t* locations, size_t count, float z,
+	              size_t t);
+
+	/// Give the plate copies of any maps it shares with another plate.
+	///
+	/// Every method that writes to the maps calls this first. Anyone else
+	/// writing through the pointers of getMap() must call it too.
+	void unshare();
+
 	float getMass() const throw() { return mass; }
 	float getMomentum() const throw() { return mass * velocity; }
 	size_t getHeight() const throw() { return height; }
@@ -218,9 +281,38 @@ class plate
 	protected:
 	private:
 
+	plate& operator=(const plate&);
+
 	SimpleRandom _randsource;    
 
-	ContinentId getContinentAt(int x, int y) const;
+
+	/// Fill the plate from a height map. Map dimensions, position and
+	/// random source must already be set.
+	void init(const float* m, size_t plate_age);
+
+	/// Replace the segment map with an uninitialized one.
+	void allocateSegments(size_t capacity);
+
+	/// Placement of the height map on the world map.
+	class mapBounds
+	{
+	  public:
+		float left, top;      ///< Left-top corner in world coords.
+		size_t width, height; ///< Dimensions along X and Y axis.
+		size_t grown_x, grown_y; ///< Columns and rows added to left and top.
+	};
+
+	mapBounds getBounds() const throw(); ///< Current placement.
+
+	/// Grow bounds to contain a world location outside of them, by as
+	/// much as setCrust has always grown plates.
+	void extendBounds(mapBounds& bounds, size_t x, size_t y) const;
+
+	/// Move the maps to grown bounds, keeping their world positions.
+	void resize(const mapBounds& bounds);
+
+	/// Set the crust at an offset within the height map.
+	void setCrustAt(size_t index, float z, size_t t);
 
 	/// Container for details about a segmented crust area on this plate.
 	class segmentData
@@ -314,6 +406,10 @@ class plate
 	/// @return		Offset in height map or -1 on error.
 	size_t getMapIndex(size_t* x, size_t* y) const throw();
 
+	/// Like getMapIndex, for a height map at other bounds.
+	size_t getMapIndex(const mapBounds& bounds, size_t* x, size_t* y) const
+		throw();
+
 	HeightMap map;        ///< Bitmap of plate's structure/height.
 	AgeMap age_map;       ///< Bitmap of plate's soil's age: timestamp of creation.
 	size_t width, height; ///< Height map's dimensions along X and Y axis.
@@ -331,6 +427,9 @@ class plate
 
 	std::vector<segmentData> seg_data; ///< Details of each crust segment.
 	ContinentId* segment;              ///< Segment ID of each piece of continental crust.
+	size_t segment_capacity;           ///< Number of IDs segment can hold.
+	std::shared_ptr<ContinentId> _segmentBuffer; ///< Owner of segment.
+	mutable bool _sharesSegments; ///< Segment map may be used by a copy.
 };
 
 #endif
@@ -16,112 +16,525 @@
  *  License along with this library; if not, see http://www.gnu.org/licenses/
  *****************************************************************************/
 
+#include "batch.hpp"
 #include "lithosphere.hpp"
 #include "platecapi.hpp"
+#include "recorder.hpp"
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <vector>
 
-class platec_api_list_elem
+// Handles are (generation, slot + 1) pairs packed into one integer, so that
+// handles of destroyed worlds are never mistaken for newer ones that reuse
+// their slot, and zero is never a valid handle.
+static const size_t HANDLE_SLOT_BITS = sizeof(size_t) * 4;
+static const size_t HANDLE_SLOT_MASK = ((size_t)1 << HANDLE_SLOT_BITS) - 1;
+
+// A registered simulation, batch or recording. It's deleted once it has
+// been destroyed and the last call using it has returned.
+template <class T>
+class platec_api_entry
 {
   public:
-	platec_api_list_elem(size_t _id, lithosphere* _data) :
-		data(_data), id(_id) { }
+	explicit platec_api_entry(T* o) : object(o) { }
+	~platec_api_entry() { delete object; }
+
+	T* const object;
+	std::mutex lock; ///< Held by the call using the object.
 
-	lithosphere* data;
-	size_t id;
+  private:
+	platec_api_entry(const platec_api_entry&);
+	platec_api_entry& operator=(const platec_api_entry&);
+};
+
+template <class T>
+class platec_api_registry
+{
+  public:
+	size_t add(T* object);
+	std::shared_ptr<platec_api_entry<T> > get(size_t handle);
+	std::shared_ptr<platec_api_entry<T> > remove(size_t handle);
+
+  private:
+	class slot
+	{
+	  public:
+		slot() : generation(1) { }
+
+		std::shared_ptr<platec_api_entry<T> > data;
+		size_t generation;
+	};
+
+	size_t find(size_t handle) const;
+
+	std::vector<slot> slots;
+	std::vector<size_t> free_slots;
+	std::mutex lock;
+};
+
+template <class T>
+size_t platec_api_registry<T>::add(T* object)
+{
+	// The object is deleted if it can't be registered.
+	std::shared_ptr<platec_api_entry<T> > entry;
+	try {
+		entry = std::make_shared<platec_api_entry<T> >(object);
+	} catch (...) {
+		delete object;
+		throw;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+
+	size_t index;
+	if (free_slots.empty()) {
+		if (slots.size() >= HANDLE_SLOT_MASK)
+			throw std::runtime_error("Too many handles in use");
+		index = slots.size();
+		slots.push_back(slot());
+	} else {
+		index = free_slots.back();
+		free_slots.pop_back();
+	}
+
+	slots[index].data = entry;
+	return (slots[index].generation << HANDLE_SLOT_BITS) | (index + 1);
+}
+
+template <class T>
+size_t platec_api_registry<T>::find(size_t handle) const
+{
+	const size_t index = (handle & HANDLE_SLOT_MASK) - 1;
+	if (index >= slots.size() || !slots[index].data ||
+	    slots[index].generation != handle >> HANDLE_SLOT_BITS)
+		return slots.size();
+
+	return index;
+}
+
+template <class T>
+std::shared_ptr<platec_api_entry<T> > platec_api_registry<T>::get(
+	size_t handle)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	const size_t index = find(handle);
+	return index < slots.size() ? slots[index].data :
+		std::shared_ptr<platec_api_entry<T> >();
+}
+
+template <class T>
+std::shared_ptr<platec_api_entry<T> > platec_api_registry<T>::remove(
+	size_t handle)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	const size_t index = find(handle);
+	if (index >= slots.size())
+		return std::shared_ptr<platec_api_entry<T> >();
+
+	std::shared_ptr<platec_api_entry<T> > entry;
+	entry.swap(slots[index].data);
+
+	// Generation zero is skipped when the counter wraps around.
+	slots[index].generation = (slots[index].generation + 1) &
+		(((size_t)-1) >> HANDLE_SLOT_BITS);
+	slots[index].generation += slots[index].generation == 0;
+
+	free_slots.push_back(index);
+	return entry;
+}
+
+// Pins a registered object for the duration of an API call, so that it
+// isn't deleted while the call runs even if another thread destroys it.
+// Other calls using the object wait until this one returns, unless either
+// only reads what never changes or may run concurrently by design.
+template <class T>
+class platec_api_use
+{
+  public:
+	platec_api_use(platec_api_registry<T>& registry, void* handle,
+	               bool exclusive = true) :
+		entry(registry.get((size_t)handle))
+	{
+		if (entry && exclusive)
+			guard = std::unique_lock<std::mutex>(entry->lock);
+	}
+
+	T* get() const { return entry ? entry->object : NULL; }
+	T* operator->() const { return entry->object; }
+
+  private:
+	std::shared_ptr<platec_api_entry<T> > entry;
+	std::unique_lock<std::mutex> guard;
 };
 
 extern lithosphere* platec_api_get_lithosphere(size_t);
 
-static std::vector<platec_api_list_elem> lithospheres;
-static size_t last_id = 1;
+static platec_api_registry<lithosphere> lithospheres;
+static platec_api_registry<simulationBatch> batches;
+static platec_api_registry<frameReader> replays;
 
+typedef platec_api_use<lithosphere> platec_api_world;
+typedef platec_api_use<simulationBatch> platec_api_batch;
+typedef platec_api_use<frameReader> platec_api_replay;
 
 void* platec_api_create(long seed, size_t width, size_t height, float sea_level,
                          size_t erosion_period, float folding_ratio,
                          size_t aggr_overlap_abs, float aggr_overlap_rel,
-                         size_t cycle_count, size_t num_plates)
+                         size_t cycle_count, size_t num_plates,
+                         size_t num_threads, float noise_tolerance,
+                         int parallel_growth, int coalesce_collisions,
+                         int classic_noise)
 {
 	/* Miten nykyisen opengl-mainin koodit refaktoroidaan tänne?
 	 *    parametrien tarkistus, kommentit eli dokumentointi, muuta? */
 
 	lithosphere* litho = new lithosphere(seed, width, height, sea_level,
 		erosion_period, folding_ratio, aggr_overlap_abs,
-		aggr_overlap_rel, cycle_count);
-	litho->createPlates(num_plates);
-
-	platec_api_list_elem elem(++last_id, litho);
-	lithospheres.push_back(elem);	
-	
-	return litho;
+		aggr_overlap_rel, cycle_count, num_threads, noise_tolerance,
+		parallel_growth != 0, coalesce_collisions != 0, classic_noise != 0);
+	try {
+		litho->createPlates(num_plates);
+	} catch (...) {
+		delete litho;
+		throw;
+	}
+	return (void*)lithospheres.add(litho);
 }
 
-void platec_api_destroy(void* litho)
-{	
-	for (size_t i = 0; i < lithospheres.size(); ++i)
-		if (lithospheres[i].data == litho) {
-			lithospheres.erase(lithospheres.begin()+i);
-			break;
-		}
+void platec_api_destroy(void* handle)
+{
+	// Calls still using the simulation keep it alive until they return.
+	lithospheres.remove((size_t)handle);
 }
 
 const size_t* platec_api_get_agemap(size_t id)
 {
-	lithosphere* litho = platec_api_get_lithosphere(id);
-	if (!litho)
+	platec_api_world litho(lithospheres, (void*)id);
+	if (!litho.get())
 		return NULL;
 
 	return litho->getAgemap();
 }
 
-float* platec_api_get_heightmap(void *pointer)
+float* platec_api_get_heightmap(void *handle)
 {
-	lithosphere* litho = (lithosphere*)pointer;
-	float *res = litho->getTopography();
-	return res;
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return NULL;
+
+	return litho->getTopography();
 }
 
-size_t* platec_api_get_platesmap(void *pointer)
+size_t* platec_api_get_platesmap(void *handle)
 {
-	lithosphere* litho = (lithosphere*)pointer;
-	size_t *res = litho->getPlatesMap();
-	return res;
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return NULL;
+
+	return litho->getPlatesMap();
 }
 
-lithosphere* platec_api_get_lithosphere(size_t id)
+size_t platec_api_copy_heightmap(void* handle, float* heightmap)
 {
-	for (size_t i = 0; i < lithospheres.size(); ++i)
-		if (lithospheres[i].id == id)
-			return lithospheres[i].data;
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return 0;
+
+	memcpy(heightmap, litho->getTopography(),
+		litho->getWidth() * litho->getHeight() * sizeof(float));
+	return 1;
+}
+
+size_t platec_api_copy_platesmap(void* handle, size_t* platesmap)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return 0;
 
-	return NULL;
+	memcpy(platesmap, litho->getPlatesMap(),
+		litho->getWidth() * litho->getHeight() * sizeof(size_t));
+	return 1;
 }
 
-size_t platec_api_is_finished(void *pointer)
+lithosphere* platec_api_get_lithosphere(size_t id)
+{
+	std::shared_ptr<platec_api_entry<lithosphere> > entry =
+		lithospheres.get(id);
+	return entry ? entry->object : NULL;
+}
+
+size_t platec_api_is_finished(void *handle)
 {
-	lithosphere* litho = (lithosphere*)pointer;
-	if (litho->isFinished()) {
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get() || litho->isFinished()) {
 		return 1;
 	} else {
 		return 0;
 	}
 }
 
-void platec_api_step(void *pointer)
-{	   
-	lithosphere* litho = (lithosphere*)pointer;
-	litho->update();
+void platec_api_step(void *handle)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (litho.get()) {
+		litho->wait();
+		litho->update();
+	}
+}
+
+void platec_api_step_async(void *handle, size_t max_queued)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (litho.get())
+		litho->stepAsync(max_queued);
+}
+
+void platec_api_wait(void *handle)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (litho.get())
+		litho->wait();
+}
+
+size_t platec_api_publish(void* handle)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return 0;
+
+	litho->wait();
+	litho->startPublishing();
+	return 1;
+}
+
+const void* platec_api_frame_acquire(void* handle)
+{
+	// Frames are taken without waiting for the call running a step.
+	platec_api_world litho(lithospheres, handle, false);
+	return litho.get() ? litho->acquireFrame() : NULL;
+}
+
+void platec_api_frame_release(const void* frame)
+{
+	lithosphere::releaseFrame(static_cast<const publishedFrame*>(frame));
+}
+
+size_t platec_api_frame_get_step(const void* frame)
+{
+	return static_cast<const publishedFrame*>(frame)->step;
+}
+
+const float* platec_api_frame_get_heightmap(const void* frame)
+{
+	return &static_cast<const publishedFrame*>(frame)->topography[0];
+}
+
+const size_t* platec_api_frame_get_platesmap(const void* frame)
+{
+	return &static_cast<const publishedFrame*>(frame)->plates[0];
+}
+
+const size_t* platec_api_frame_get_agemap(const void* frame)
+{
+	return &static_cast<const publishedFrame*>(frame)->ages[0];
+}
+
+size_t platec_api_record_start(void* handle, const char* path, size_t interval)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return 0;
+
+	litho->wait();
+	litho->startRecording(path, interval);
+	return 1;
+}
+
+size_t platec_api_record_stop(void* handle)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return 0;
+
+	litho->wait();
+	litho->stopRecording();
+	return 1;
+}
+
+void* platec_api_replay_open(const char* path)
+{
+	return (void*)replays.add(new frameReader(path));
+}
+
+void platec_api_replay_close(void* handle)
+{
+	// Calls still using the recording keep it open until they return.
+	replays.remove((size_t)handle);
+}
+
+size_t platec_api_replay_next(void* handle)
+{
+	platec_api_replay replay(replays, handle);
+	return replay.get() && replay->next() ? 1 : 0;
+}
+
+size_t platec_api_replay_next_copy(void* handle, size_t* step,
+                                   float* heightmap, size_t* platesmap)
+{
+	platec_api_replay replay(replays, handle);
+	if (!replay.get() || !replay->next())
+		return 0;
+
+	const size_t area = replay->getWidth() * replay->getHeight();
+	*step = replay->getStep();
+	memcpy(heightmap, replay->getTopography(), area * sizeof(float));
+	memcpy(platesmap, replay->getPlatesMap(), area * sizeof(size_t));
+	return 1;
+}
+
+size_t platec_api_replay_get_step(void* handle)
+{
+	platec_api_replay replay(replays, handle);
+	return replay.get() ? replay->getStep() : 0;
+}
+
+size_t platec_api_replay_get_width(void* handle)
+{
+	platec_api_replay replay(replays, handle, false);
+	return replay.get() ? replay->getWidth() : 0;
+}
+
+size_t platec_api_replay_get_height(void* handle)
+{
+	platec_api_replay replay(replays, handle, false);
+	return replay.get() ? replay->getHeight() : 0;
+}
+
+const float* platec_api_replay_get_heightmap(void* handle)
+{
+	platec_api_replay replay(replays, handle);
+	return replay.get() ? replay->getTopography() : NULL;
+}
+
+const size_t* platec_api_replay_get_platesmap(void* handle)
+{
+	platec_api_replay replay(replays, handle);
+	return replay.get() ? replay->getPlatesMap() : NULL;
+}
+
+void* platec_api_fork(void* handle, size_t erosion_period, float folding_ratio,
+                       size_t aggr_overlap_abs, float aggr_overlap_rel,
+                       size_t num_threads)
+{
+	platec_api_world parent(lithospheres, handle);
+	if (!parent.get())
+		return NULL;
+
+	parent->wait();
+	return (void*)lithospheres.add(parent->fork(erosion_period,
+		folding_ratio, aggr_overlap_abs, aggr_overlap_rel, num_threads));
+}
+
+size_t platec_api_save(void* handle, const char* path)
+{
+	platec_api_world litho(lithospheres, handle);
+	if (!litho.get())
+		return 0;
+
+	litho->wait();
+	litho->save(path);
+	return 1;
+}
+
+void* platec_api_load(const char* path, size_t num_threads)
+{
+	return (void*)lithospheres.add(lithosphere::load(path, num_threads));
+}
+
+
+size_t lithosphere_getMapWidth ( void* handle)
+{
+    platec_api_world litho(lithospheres, handle, false);
+    return litho.get() ? litho->getWidth() : 0;
 }
 
+size_t lithosphere_getMapHeight ( void* handle)
+{
+    platec_api_world litho(lithospheres, handle, false);
+    return litho.get() ? litho->getHeight() : 0;
+}
+
+void* platec_api_batch_create(const long* seeds, size_t num_seeds,
+                         size_t width, size_t height, float sea_level,
+                         size_t erosion_period, float folding_ratio,
+                         size_t aggr_overlap_abs, float aggr_overlap_rel,
+                         size_t cycle_count, size_t num_plates,
+                         size_t num_threads, size_t memory_budget)
+{
+	return (void*)batches.add(new simulationBatch(
+		std::vector<long>(seeds, seeds + num_seeds),
+		width, height, sea_level, erosion_period, folding_ratio,
+		aggr_overlap_abs, aggr_overlap_rel, cycle_count, num_plates,
+		num_threads, memory_budget));
+}
+
+void platec_api_batch_destroy(void* handle)
+{
+	// Calls still using the batch keep it alive until they return.
+	batches.remove((size_t)handle);
+}
+
+size_t platec_api_batch_next(void* handle)
+{
+	platec_api_batch batch(batches, handle);
+	return batch.get() && batch->next() ? 1 : 0;
+}
+
+size_t platec_api_batch_next_copy(void* handle, long* seed,
+                                  float* heightmap, size_t* platesmap)
+{
+	platec_api_batch batch(batches, handle);
+	if (!batch.get() || !batch->next())
+		return 0;
+
+	const size_t area = batch->getWidth() * batch->getHeight();
+	*seed = batch->getSeed();
+	memcpy(heightmap, batch->getTopography(), area * sizeof(float));
+	memcpy(platesmap, batch->getPlatesMap(), area * sizeof(size_t));
+	return 1;
+}
+
+long platec_api_batch_get_seed(void* handle)
+{
+	platec_api_batch batch(batches, handle);
+	return batch.get() ? batch->getSeed() : 0;
+}
+
+size_t platec_api_batch_get_width(void* handle)
+{
+	platec_api_batch batch(batches, handle, false);
+	return batch.get() ? batch->getWidth() : 0;
+}
+
+size_t platec_api_batch_get_height(void* handle)
+{
+	platec_api_batch batch(batches, handle, false);
+	return batch.get() ? batch->getHeight() : 0;
+}
 
-size_t lithosphere_getMapWidth ( void* object)
+const float* platec_api_batch_get_heightmap(void* handle)
 {
-    return static_cast<lithosphere*>( object)->getWidth();
+	platec_api_batch batch(batches, handle);
+	return batch.get() ? batch->getTopography() : NULL;
 }
 
-size_t lithosphere_getMapHeight ( void* object)
+const size_t* platec_api_batch_get_platesmap(void* handle)
 {
-    return static_cast<lithosphere*>( object)->getHeight();
+	platec_api_batch batch(batches, handle);
+	return batch.get() ? batch->getPlatesMap() : NULL;
 }
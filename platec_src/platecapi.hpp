@@ -21,6 +21,13 @@
 
 #include <string.h> // For size_t.
 
+/* Simulations are referred to by opaque handles. Functions given a handle
+ * that was never returned by platec_api_create, or that has already been
+ * destroyed, do nothing and return NULL or 0 (is_finished returns 1).
+ * Handles may be created, used and destroyed from any thread. Calls given
+ * the same handle run one at a time, except for platec_api_frame_acquire,
+ * and a simulation destroyed while a call uses it is freed once the call
+ * returns. */
 void *  platec_api_create(
 	    long seed,
         size_t width,
@@ -28,7 +35,12 @@ void *  platec_api_create(
         float sea_level,
         size_t erosion_period, float folding_ratio,
         size_t aggr_overlap_abs, float aggr_overlap_rel,
-        size_t cycle_count, size_t num_plates);
+        size_t cycle_count, size_t num_plates,
+        size_t num_threads = 1,
+        float noise_tolerance = 0.0f,
+        int parallel_growth = 0,
+        int coalesce_collisions = 0,
+        int classic_noise = 0);
 
 void    platec_api_destroy(void*);
 const size_t* platec_api_get_agemap(size_t);
@@ -37,6 +49,100 @@ size_t* platec_api_get_platesmap(void*);
 size_t  platec_api_is_finished(void*);
 void    platec_api_step(void*);
 
+/* Copy the height or plates map into a buffer of width * height elements.
+ * Unlike the pointers returned above, the copies stay consistent while other
+ * threads step the simulation. Both return 0 for an invalid handle. */
+size_t  platec_api_copy_heightmap(void*, float* heightmap);
+size_t  platec_api_copy_platesmap(void*, size_t* platesmap);
+
+/* Queue a step to run on a thread of the simulation's own, waiting while
+ * max_queued steps are queued already. Until platec_api_wait is called, the
+ * maps and is_finished describe the latest finished step, and the maps
+ * stay valid until the next call to either function. Every other function
+ * given the handle waits for the queued steps first. */
+void    platec_api_step_async(void*, size_t max_queued = 1);
+void    platec_api_wait(void*);
+
+/* Publish the maps after every step, so that other threads can read the
+ * latest ones while the simulation runs. Returns 0 for an invalid handle.
+ * platec_api_frame_acquire takes the latest frame, or NULL if nothing has
+ * been published, without blocking the simulation. It may be called from
+ * any thread at any time. A frame stays unchanged until it's released, and
+ * all frames must be released before the simulation is destroyed. */
+size_t  platec_api_publish(void*);
+const void* platec_api_frame_acquire(void*);
+void    platec_api_frame_release(const void* frame);
+size_t  platec_api_frame_get_step(const void* frame);
+const float* platec_api_frame_get_heightmap(const void* frame);
+const size_t* platec_api_frame_get_platesmap(const void* frame);
+const size_t* platec_api_frame_get_agemap(const void* frame);
+
+/* Append the height and plates maps after every interval'th step to a file.
+ * Frames are written on a background thread; platec_api_record_stop writes
+ * the remaining ones and throws if any couldn't be written. Both return 0
+ * for an invalid handle. */
+size_t  platec_api_record_start(void*, const char* path, size_t interval);
+size_t  platec_api_record_stop(void*);
+
+/* Read the frames of a recording in order. platec_api_replay_next returns 0
+ * after the last frame. The maps of a frame stay valid until the next call
+ * to platec_api_replay_next or _close. platec_api_replay_next_copy reads the
+ * next frame into buffers of width * height elements instead, so that other
+ * threads may use the recording meanwhile. Replay handles are checked like
+ * those of simulations. */
+void *  platec_api_replay_open(const char* path);
+void    platec_api_replay_close(void*);
+size_t  platec_api_replay_next(void*);
+size_t  platec_api_replay_next_copy(void*, size_t* step, float* heightmap,
+                                    size_t* platesmap);
+size_t  platec_api_replay_get_step(void*);
+size_t  platec_api_replay_get_width(void*);
+size_t  platec_api_replay_get_height(void*);
+const float* platec_api_replay_get_heightmap(void*);
+const size_t* platec_api_replay_get_platesmap(void*);
+
+/* Branch off a copy of a running simulation that continues with other
+ * settings. The copy shares the plates' data with the original until either
+ * of them steps. Returns NULL for an invalid handle. */
+void *  platec_api_fork(void*,
+        size_t erosion_period, float folding_ratio,
+        size_t aggr_overlap_abs, float aggr_overlap_rel,
+        size_t num_threads = 1);
+
+/* Write the complete state of a simulation to a file, so that it can be
+ * resumed later with platec_api_load and continue exactly as it would have.
+ * Returns 1 on success and 0 for an invalid handle. Files are only valid on
+ * machines of the same byte order. */
+size_t  platec_api_save(void*, const char* path);
+void *  platec_api_load(const char* path, size_t num_threads = 1);
+
+/* Simulate one world per seed concurrently with shared parameters.
+ * Finished worlds are read one at a time with platec_api_batch_next,
+ * which returns 0 once every world has been read. The maps of a world stay
+ * valid until the next call to platec_api_batch_next or _destroy.
+ * platec_api_batch_next_copy reads the next world into buffers of width *
+ * height elements instead, so that other threads may use the batch
+ * meanwhile. Batch handles are checked like those of simulations. */
+void *  platec_api_batch_create(
+        const long* seeds, size_t num_seeds,
+        size_t width,
+        size_t height,
+        float sea_level,
+        size_t erosion_period, float folding_ratio,
+        size_t aggr_overlap_abs, float aggr_overlap_rel,
+        size_t cycle_count, size_t num_plates,
+        size_t num_threads, size_t memory_budget);
+
+void    platec_api_batch_destroy(void*);
+size_t  platec_api_batch_next(void*);
+size_t  platec_api_batch_next_copy(void*, long* seed, float* heightmap,
+                                   size_t* platesmap);
+long    platec_api_batch_get_seed(void*);
+size_t  platec_api_batch_get_width(void*);
+size_t  platec_api_batch_get_height(void*);
+const float* platec_api_batch_get_heightmap(void*);
+const size_t* platec_api_batch_get_platesmap(void*);
+
 size_t lithosphere_getMapWidth ( void* object);
 size_t lithosphere_getMapHeight ( void* object);
 
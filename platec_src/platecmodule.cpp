@@ -4,6 +4,9 @@
 #endif
 #include <cmath>
 #include <Python.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 static PyObject * platec_create(PyObject *self, PyObject *args)
 {
@@ -17,39 +20,118 @@ static PyObject * platec_create(PyObject *self, PyObject *args)
     float aggr_overlap_rel;
     unsigned int cycle_count;
     unsigned int num_plates;
-    if (!PyArg_ParseTuple(args, "IIIfIfIfII", &seed, &width, &height, &sea_level, &erosion_period,
+    unsigned int num_threads = 1;
+    float noise_tolerance = 0.0f;
+    int parallel_growth = 0;
+    int coalesce_collisions = 0;
+    int classic_noise = 0;
+    if (!PyArg_ParseTuple(args, "IIIfIfIfII|Ifiii", &seed, &width, &height, &sea_level, &erosion_period,
             &folding_ratio, &aggr_overlap_abs, &aggr_overlap_rel,
-            &cycle_count, &num_plates))
+            &cycle_count, &num_plates, &num_threads, &noise_tolerance,
+            &parallel_growth, &coalesce_collisions, &classic_noise))
         return NULL; 
     srand(seed);
 
-    void *litho = platec_api_create(seed, width, height, sea_level, erosion_period,
-            folding_ratio, aggr_overlap_abs, aggr_overlap_rel,
-            cycle_count, num_plates);
+    void *litho;
+    try {
+        litho = platec_api_create(seed, width, height, sea_level, erosion_period,
+                folding_ratio, aggr_overlap_abs, aggr_overlap_rel,
+                cycle_count, num_plates, num_threads, noise_tolerance,
+                parallel_growth, coalesce_collisions, classic_noise);
+    } catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
 
-    long pointer = (long)litho;
-    return Py_BuildValue("l", pointer);
+    // Handles are passed as Py_ssize_t, which is as wide as a pointer on
+    // every platform, unlike long on Win64.
+    return Py_BuildValue("n", (Py_ssize_t)litho);
 }
 
 static PyObject * platec_step(PyObject *self, PyObject *args)
 {
-    void *litho;
-    if (!PyArg_ParseTuple(args, "l", &litho))
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
         return NULL; 
-    platec_api_step(litho);
+    void *litho = (void*)handle;
+
+    // Other calls given the same simulation wait for the step, and one
+    // destroying it meanwhile leaves it to be freed when the step is over.
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        platec_api_step(litho);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_step_async(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    unsigned int max_queued = 1;
+    if (!PyArg_ParseTuple(args, "n|I", &handle, &max_queued))
+        return NULL;
+    void *litho = (void*)handle;
+
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        platec_api_step_async(litho, max_queued);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_wait(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *litho = (void*)handle;
+
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        platec_api_wait(litho);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
     return Py_BuildValue("i", 0);
 }
 
 static PyObject * platec_destroy(PyObject *self, PyObject *args)
 {
-    void *litho;
-    if (!PyArg_ParseTuple(args, "l", &litho))
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
         return NULL; 
+    void *litho = (void*)handle;
+    // The GIL stays held, so no get_frame is reading the simulation's frames.
     platec_api_destroy(litho);
     return Py_BuildValue("i", 0);
 }
 
-PyObject *makelist(float array[], size_t size) {
+PyObject *makelist(const float array[], size_t size) {
     PyObject *l = PyList_New(size);
     for (size_t i = 0; i != size; ++i) {
         PyList_SET_ITEM(l, i, Py_BuildValue("f",array[i]));
@@ -57,7 +139,7 @@ PyObject *makelist(float array[], size_t size) {
     return l;
 }
 
-PyObject *makelist_int(size_t array[], size_t size) {
+PyObject *makelist_int(const size_t array[], size_t size) {
     PyObject *l = PyList_New(size);
     for (size_t i = 0; i != size; ++i) {
         PyList_SET_ITEM(l, i, Py_BuildValue("i",array[i]));
@@ -68,15 +150,24 @@ PyObject *makelist_int(size_t array[], size_t size) {
 static PyObject * platec_get_heightmap(PyObject *self, PyObject *args)
 {
     size_t id;
-    void *litho;
-    if (!PyArg_ParseTuple(args, "l", &litho))
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
         return NULL; 
-    float *hm = platec_api_get_heightmap(litho);
-
+    void *litho = (void*)handle;
     size_t width = lithosphere_getMapWidth(litho);
     size_t height = lithosphere_getMapHeight(litho);
 
-    PyObject* res =  makelist(hm,width*height);
+    std::vector<float> hm(width * height);
+    size_t found = 0;
+    Py_BEGIN_ALLOW_THREADS
+    found = platec_api_copy_heightmap(litho, hm.empty() ? NULL : &hm[0]);
+    Py_END_ALLOW_THREADS
+    if (!found) {
+        PyErr_SetString(PyExc_ValueError, "invalid simulation handle");
+        return NULL;
+    }
+
+    PyObject* res =  makelist(&hm[0],width*height);
     Py_INCREF(res);
     return res;
 }
@@ -84,15 +175,24 @@ static PyObject * platec_get_heightmap(PyObject *self, PyObject *args)
 static PyObject * platec_get_platesmap(PyObject *self, PyObject *args)
 {
     size_t id;
-    void *litho;
-    if (!PyArg_ParseTuple(args, "l", &litho))
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
         return NULL; 
-    size_t *hm = platec_api_get_platesmap(litho);
-
+    void *litho = (void*)handle;
     size_t width = lithosphere_getMapWidth(litho);
     size_t height = lithosphere_getMapHeight(litho);
 
-    PyObject* res =  makelist_int(hm,width*height);
+    std::vector<size_t> hm(width * height);
+    size_t found = 0;
+    Py_BEGIN_ALLOW_THREADS
+    found = platec_api_copy_platesmap(litho, hm.empty() ? NULL : &hm[0]);
+    Py_END_ALLOW_THREADS
+    if (!found) {
+        PyErr_SetString(PyExc_ValueError, "invalid simulation handle");
+        return NULL;
+    }
+
+    PyObject* res =  makelist_int(&hm[0],width*height);
     Py_INCREF(res);
     return res;
 }
@@ -100,16 +200,386 @@ static PyObject * platec_get_platesmap(PyObject *self, PyObject *args)
 static PyObject * platec_is_finished(PyObject *self, PyObject *args)
 {
     size_t id;
-    void *litho;
-    if (!PyArg_ParseTuple(args, "l", &litho))
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
         return NULL; 
-    PyObject* res = Py_BuildValue("b",platec_api_is_finished(litho));
+    void *litho = (void*)handle;
+    size_t finished = 1;
+    Py_BEGIN_ALLOW_THREADS
+    finished = platec_api_is_finished(litho);
+    Py_END_ALLOW_THREADS
+    PyObject* res = Py_BuildValue("b",finished);
     return res;
 }
 
+static PyObject * platec_batch_create(PyObject *self, PyObject *args)
+{
+    PyObject *seed_list;
+    unsigned int width;
+    unsigned int height;
+    float sea_level;
+    unsigned int erosion_period;
+    float folding_ratio;
+    unsigned int aggr_overlap_abs;
+    float aggr_overlap_rel;
+    unsigned int cycle_count;
+    unsigned int num_plates;
+    unsigned int num_threads = 0;
+    Py_ssize_t memory_budget = 0;
+    if (!PyArg_ParseTuple(args, "OIIfIfIfII|In", &seed_list, &width, &height,
+            &sea_level, &erosion_period, &folding_ratio, &aggr_overlap_abs,
+            &aggr_overlap_rel, &cycle_count, &num_plates, &num_threads,
+            &memory_budget))
+        return NULL;
+
+    PyObject *seq = PySequence_Fast(seed_list, "seeds must be a sequence");
+    if (!seq)
+        return NULL;
+    std::vector<long> seeds(PySequence_Fast_GET_SIZE(seq));
+    for (size_t i = 0; i < seeds.size(); ++i)
+        seeds[i] = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+    Py_DECREF(seq);
+    if (PyErr_Occurred())
+        return NULL;
+
+    void *batch;
+    try {
+        batch = platec_api_batch_create(seeds.empty() ? NULL : &seeds[0],
+                seeds.size(), width, height, sea_level, erosion_period,
+                folding_ratio, aggr_overlap_abs, aggr_overlap_rel, cycle_count,
+                num_plates, num_threads, memory_budget > 0 ? memory_budget : 0);
+    } catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+
+    return Py_BuildValue("n", (Py_ssize_t)batch);
+}
+
+static PyObject * platec_batch_next(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *batch = (void*)handle;
+
+    // The world is copied within the call, so that the batch may be used
+    // and destroyed by other threads once it returns.
+    size_t area = platec_api_batch_get_width(batch) *
+                  platec_api_batch_get_height(batch);
+    if (!area) {
+        PyErr_SetString(PyExc_ValueError, "invalid batch handle");
+        return NULL;
+    }
+    std::vector<float> heightmap(area);
+    std::vector<size_t> platesmap(area);
+    long seed = 0;
+    size_t has_world = 0;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        has_world = platec_api_batch_next_copy(batch, &seed, &heightmap[0],
+                &platesmap[0]);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!has_world)
+        Py_RETURN_NONE;
+
+    PyObject *hm = makelist(&heightmap[0], area);
+    PyObject *pm = makelist_int(&platesmap[0], area);
+    return Py_BuildValue("lNN", seed, hm, pm);
+}
+
+static PyObject * platec_batch_destroy(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *batch = (void*)handle;
+    Py_BEGIN_ALLOW_THREADS
+    platec_api_batch_destroy(batch);
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_publish(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *litho = (void*)handle;
+
+    size_t found = 0;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        found = platec_api_publish(litho);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!found) {
+        PyErr_SetString(PyExc_ValueError, "invalid simulation handle");
+        return NULL;
+    }
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_get_frame(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *litho = (void*)handle;
+
+    // The GIL stays held until the frame is released, so that the
+    // simulation can't be destroyed meanwhile.
+    const void *frame = platec_api_frame_acquire(litho);
+    if (!frame)
+        Py_RETURN_NONE;
+
+    size_t area = lithosphere_getMapWidth(litho) * lithosphere_getMapHeight(litho);
+    PyObject *hm = makelist(platec_api_frame_get_heightmap(frame), area);
+    PyObject *pm = makelist_int(platec_api_frame_get_platesmap(frame), area);
+    PyObject *am = makelist_int(platec_api_frame_get_agemap(frame), area);
+    size_t step = platec_api_frame_get_step(frame);
+    platec_api_frame_release(frame);
+    return Py_BuildValue("nNNN", (Py_ssize_t)step, hm, pm, am);
+}
+
+static PyObject * platec_record(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    const char *path;
+    unsigned int interval = 1;
+    if (!PyArg_ParseTuple(args, "ns|I", &handle, &path, &interval))
+        return NULL;
+    void *litho = (void*)handle;
+
+    size_t found = 0;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        found = platec_api_record_start(litho, path, interval);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!found) {
+        PyErr_SetString(PyExc_ValueError, "invalid simulation handle");
+        return NULL;
+    }
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_record_stop(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *litho = (void*)handle;
+
+    size_t found = 0;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        found = platec_api_record_stop(litho);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!found) {
+        PyErr_SetString(PyExc_ValueError, "invalid simulation handle");
+        return NULL;
+    }
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_replay_open(PyObject *self, PyObject *args)
+{
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+
+    void *replay;
+    try {
+        replay = platec_api_replay_open(path);
+    } catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+
+    return Py_BuildValue("n", (Py_ssize_t)replay);
+}
+
+static PyObject * platec_replay_next(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *replay = (void*)handle;
+
+    // The frame is copied within the call, so that the recording may be
+    // used and closed by other threads once it returns.
+    size_t area = platec_api_replay_get_width(replay) *
+                  platec_api_replay_get_height(replay);
+    if (!area) {
+        PyErr_SetString(PyExc_ValueError, "invalid replay handle");
+        return NULL;
+    }
+    std::vector<float> heightmap(area);
+    std::vector<size_t> platesmap(area);
+    size_t step = 0;
+    size_t has_frame = 0;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        has_frame = platec_api_replay_next_copy(replay, &step, &heightmap[0],
+                &platesmap[0]);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!has_frame)
+        Py_RETURN_NONE;
+
+    PyObject *hm = makelist(&heightmap[0], area);
+    PyObject *pm = makelist_int(&platesmap[0], area);
+    return Py_BuildValue("nNN", (Py_ssize_t)step, hm, pm);
+}
+
+static PyObject * platec_replay_close(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    if (!PyArg_ParseTuple(args, "n", &handle))
+        return NULL;
+    void *replay = (void*)handle;
+    platec_api_replay_close(replay);
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_fork(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    unsigned int erosion_period;
+    float folding_ratio;
+    unsigned int aggr_overlap_abs;
+    float aggr_overlap_rel;
+    unsigned int num_threads = 1;
+    if (!PyArg_ParseTuple(args, "nIfIf|I", &handle, &erosion_period,
+            &folding_ratio, &aggr_overlap_abs, &aggr_overlap_rel,
+            &num_threads))
+        return NULL;
+    void *litho = (void*)handle;
+
+    void *copy = NULL;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        copy = platec_api_fork(litho, erosion_period, folding_ratio,
+                aggr_overlap_abs, aggr_overlap_rel, num_threads);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!copy) {
+        PyErr_SetString(PyExc_ValueError, "invalid simulation handle");
+        return NULL;
+    }
+
+    return Py_BuildValue("n", (Py_ssize_t)copy);
+}
+
+static PyObject * platec_save(PyObject *self, PyObject *args)
+{
+    Py_ssize_t handle;
+    const char *path;
+    if (!PyArg_ParseTuple(args, "ns", &handle, &path))
+        return NULL;
+    void *litho = (void*)handle;
+
+    size_t saved = 0;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        saved = platec_api_save(litho, path);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!saved) {
+        PyErr_SetString(PyExc_ValueError, "invalid simulation handle");
+        return NULL;
+    }
+    return Py_BuildValue("i", 0);
+}
+
+static PyObject * platec_load(PyObject *self, PyObject *args)
+{
+    const char *path;
+    unsigned int num_threads = 1;
+    if (!PyArg_ParseTuple(args, "s|I", &path, &num_threads))
+        return NULL;
+
+    void *litho = NULL;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        litho = platec_api_load(path, num_threads);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    return Py_BuildValue("n", (Py_ssize_t)litho);
+}
+
 static PyMethodDef PlatecMethods[] = {
     {"create",  platec_create, METH_VARARGS,
-     "Create initial plates configuration."},
+     "Create initial plates configuration. An optional last argument sets the\n"
+     "number of threads (default 1, 0 = share one pool sized to the machine)."},
     {"destroy",  platec_destroy, METH_VARARGS,
      "Release the data for the simulation."},
     {"get_heightmap",  platec_get_heightmap, METH_VARARGS,
@@ -120,6 +590,48 @@ static PyMethodDef PlatecMethods[] = {
      "Perform next step of the simulation."},     
     {"is_finished",  platec_is_finished, METH_VARARGS,
      "Is the simulation finished?"},       
+    {"step_async", platec_step_async, METH_VARARGS,
+     "Start the next step of the simulation on a thread of its own. While it\n"
+     "runs, the maps of the latest finished step can be read. An optional\n"
+     "second argument sets how many steps may be queued (default 1)."},
+    {"wait", platec_wait, METH_VARARGS,
+     "Wait for the steps started by step_async to finish."},
+    {"batch_create",  platec_batch_create, METH_VARARGS,
+     "Simulate one world per seed in a list concurrently. Takes the seeds and\n"
+     "the rest of create's arguments, then optionally the number of threads\n"
+     "(default 0 = one per core) and a memory budget in bytes (0 = no limit)."},
+    {"batch_next",  platec_batch_next, METH_VARARGS,
+     "Wait for the next world of a batch to finish. Returns a tuple of its\n"
+     "seed, heightmap and plates map, or None when all have been returned."},
+    {"batch_destroy",  platec_batch_destroy, METH_VARARGS,
+     "Abort the unfinished worlds of a batch and release its data."},
+    {"publish",  platec_publish, METH_VARARGS,
+     "Publish the maps after every step, so that other threads can read\n"
+     "them with get_frame while the simulation runs."},
+    {"get_frame",  platec_get_frame, METH_VARARGS,
+     "Get the latest published step as a tuple of its number, heightmap,\n"
+     "plates map and age map, or None if publish hasn't been called."},
+    {"record",  platec_record, METH_VARARGS,
+     "Record the maps after every Nth step of a simulation to a file. Takes\n"
+     "the simulation, the path and optionally N (default 1)."},
+    {"record_stop",  platec_record_stop, METH_VARARGS,
+     "Finish writing the recording of a simulation."},
+    {"replay_open",  platec_replay_open, METH_VARARGS,
+     "Open a recording for reading its frames."},
+    {"replay_next",  platec_replay_next, METH_VARARGS,
+     "Read the next frame of a recording. Returns a tuple of its step,\n"
+     "heightmap and plates map, or None after the last frame."},
+    {"replay_close",  platec_replay_close, METH_VARARGS,
+     "Close a recording opened with replay_open."},
+    {"fork",  platec_fork, METH_VARARGS,
+     "Branch off a copy of a simulation that continues with another erosion\n"
+     "period, folding ratio and aggregation overlaps, then optionally the\n"
+     "number of threads (default 1). Returns a new simulation handle."},
+    {"save",  platec_save, METH_VARARGS,
+     "Write the complete state of a simulation to a file."},
+    {"load",  platec_load, METH_VARARGS,
+     "Resume a simulation saved to a file. Takes the path and optionally the\n"
+     "number of threads (default 1). Returns a new simulation handle."},
     {NULL, NULL, 0, NULL} /* Sentinel */
 };
 
@@ -0,0 +1,57 @@
+#include "publisher.hpp"
+
+framePublisher::framePublisher() : _latest(NULL)
+{
+}
+
+framePublisher::~framePublisher() throw()
+{
+    for (size_t i = 0; i < _frames.size(); ++i)
+        delete _frames[i];
+}
+
+void framePublisher::publish(size_t step, const float* heights,
+    const size_t* plates, const size_t* ages, size_t area)
+{
+    // The latest frame may be acquired at any moment, others only while
+    // they're still the latest (see acquire), so a free one can be reused.
+    const publishedFrame* latest = _latest.load();
+    publishedFrame* frame = NULL;
+    for (size_t i = 0; i < _frames.size() && !frame; ++i)
+        if (_frames[i] != latest && _frames[i]->_readers.load() == 0)
+            frame = _frames[i];
+    if (!frame)
+    {
+        _frames.push_back(new publishedFrame());
+        frame = _frames.back();
+    }
+
+    frame->step = step;
+    frame->topography.assign(heights, heights + area);
+    frame->plates.assign(plates, plates + area);
+    frame->ages.assign(ages, ages + area);
+    _latest.store(frame);
+}
+
+const publishedFrame* framePublisher::acquire() const
+{
+    for (;;)
+    {
+        publishedFrame* frame = _latest.load();
+        if (!frame)
+            return NULL;
+
+        // Holding the frame keeps publish() from reusing it from now on.
+        // If it's no longer the latest, publish() may have taken it
+        // before, so try again with the newer one.
+        frame->_readers.fetch_add(1);
+        if (_latest.load() == frame)
+            return frame;
+        frame->_readers.fetch_sub(1);
+    }
+}
+
+void framePublisher::release(const publishedFrame* frame)
+{
+    const_cast<publishedFrame*>(frame)->_readers.fetch_sub(1);
+}
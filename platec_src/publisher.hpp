@@ -0,0 +1,62 @@
+#ifndef PUBLISHER_HPP
+#define PUBLISHER_HPP
+
+#include <cstring> // For size_t.
+#include <atomic>
+#include <vector>
+
+/// Maps of a system after one of its steps, see framePublisher.
+class publishedFrame
+{
+  public:
+	size_t step; ///< Number of steps simulated before the frame.
+	std::vector<float> topography;
+	std::vector<size_t> plates;
+	std::vector<size_t> ages;
+
+  private:
+	friend class framePublisher;
+
+	publishedFrame() : step(0), _readers(0) {}
+
+	std::atomic<size_t> _readers; ///< Number of acquire()s not released.
+};
+
+/**
+ * Hands the latest frame of a system to readers on any number of threads.
+ *
+ * The simulation writes each frame into a buffer that no reader holds and
+ * then makes it the latest one. Readers take the latest frame without
+ * locking and hold it until they release it. Buffers are reused once no
+ * reader holds them; if all are held, the simulation allocates another
+ * one instead of waiting. Neither side ever blocks the other.
+ */
+class framePublisher
+{
+  public:
+
+	framePublisher();
+	~framePublisher() throw(); ///< No frame may be held any more.
+
+	/// Make the given maps the latest frame. Only one thread at a time
+	/// may publish.
+	void publish(size_t step, const float* heights, const size_t* plates,
+	             const size_t* ages, size_t area);
+
+	/// Take the latest frame, or NULL if none has been published. May be
+	/// called from any thread.
+	const publishedFrame* acquire() const;
+
+	/// Give back a frame taken by acquire(). May be called from any thread.
+	static void release(const publishedFrame* frame);
+
+  private:
+
+	framePublisher(const framePublisher&);
+	framePublisher& operator=(const framePublisher&);
+
+	std::vector<publishedFrame*> _frames; ///< Only used by publish().
+	std::atomic<publishedFrame*> _latest;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#include "recorder.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+static const char RECORDING_MAGIC[8] = { 'P', 'L', 'A', 'T', 'E', 'C', 'F', 'R' };
+static const uint32_t RECORDING_VERSION = 1;
+static const uint32_t RECORDING_BYTE_ORDER_MARK = 0x01020304;
+static const size_t MAX_PENDING_FRAMES = 4; ///< Frames queued before add() waits.
+static const uint32_t NO_PLATE = 0xffffffff;
+
+typedef unsigned long long StoredSize;
+
+static void putVarint(std::vector<unsigned char>& out, size_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        out.push_back((unsigned char)(value | 0x80));
+    out.push_back((unsigned char)value);
+}
+
+static bool getVarint(const unsigned char*& in, const unsigned char* end,
+                      size_t& value)
+{
+    value = 0;
+    for (size_t shift = 0; in < end && shift < 8 * sizeof(size_t); shift += 7)
+    {
+        const unsigned char byte = *in++;
+        value |= (size_t)(byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return true;
+    }
+    return false;
+}
+
+/// Encode the words of a frame as runs of words that are equal to and
+/// differ from those of the previous frame.
+static void encodeFrame(const std::vector<uint32_t>& words,
+    const std::vector<uint32_t>& previous, std::vector<unsigned char>& out)
+{
+    const size_t n = words.size();
+    out.clear();
+    for (size_t i = 0; i < n; )
+    {
+        const size_t same_start = i;
+        while (i < n && words[i] == previous[i])
+            ++i;
+        const size_t diff_start = i;
+        while (i < n && words[i] != previous[i])
+            ++i;
+
+        putVarint(out, diff_start - same_start);
+        putVarint(out, i - diff_start);
+        const size_t at = out.size();
+        out.resize(at + (i - diff_start) * sizeof(uint32_t));
+        for (size_t j = diff_start; j < i; ++j)
+        {
+            const uint32_t x = words[j] ^ previous[j];
+            memcpy(&out[at + (j - diff_start) * sizeof(uint32_t)], &x,
+                sizeof(x));
+        }
+    }
+}
+
+frameRecorder::frameRecorder(const char* path, size_t width, size_t height,
+    size_t interval) :
+    _file(NULL),
+    _path(path),
+    _area(width * height),
+    _interval(interval),
+    _previous(2 * width * height, 0),
+    _stop(false)
+{
+    if (interval == 0)
+        throw std::invalid_argument("recording interval should be greater than zero");
+
+    _file = fopen(path, "wb");
+    if (!_file)
+        throw std::runtime_error("Cannot create recording " + _path);
+
+    const StoredSize dims[2] = { width, height };
+    if (fwrite(RECORDING_MAGIC, sizeof(RECORDING_MAGIC), 1, _file) != 1 ||
+        fwrite(&RECORDING_VERSION, sizeof(uint32_t), 1, _file) != 1 ||
+        fwrite(&RECORDING_BYTE_ORDER_MARK, sizeof(uint32_t), 1, _file) != 1 ||
+        fwrite(dims, sizeof(dims), 1, _file) != 1)
+    {
+        fclose(_file);
+        throw std::runtime_error("Cannot write recording " + _path);
+    }
+
+    _writer = std::thread(&frameRecorder::writerMain, this);
+}
+
+frameRecorder::~frameRecorder() throw()
+{
+    finish();
+}
+
+void frameRecorder::add(size_t step, const float* heights, const size_t* plates)
+{
+    if (step % _interval != 0)
+        return;
+
+    frame* f;
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        _frameWritten.wait(guard, [this] {
+            return _pending.size() < MAX_PENDING_FRAMES || !_error.empty(); });
+        if (!_error.empty() || _stop)
+            return;
+
+        if (_spare.empty())
+            f = new frame();
+        else
+        {
+            f = _spare.back();
+            _spare.pop_back();
+        }
+    }
+
+    // Only this copy costs the simulation any time.
+    f->step = step;
+    f->words.resize(2 * _area);
+    memcpy(&f->words[0], heights, _area * sizeof(float));
+    for (size_t i = 0; i < _area; ++i)
+        f->words[_area + i] = plates[i] < NO_PLATE ? (uint32_t)plates[i] : NO_PLATE;
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pending.push_back(f);
+    }
+    _frameReady.notify_one();
+}
+
+void frameRecorder::close()
+{
+    finish();
+    if (!_error.empty())
+        throw std::runtime_error(_error);
+}
+
+void frameRecorder::finish() throw()
+{
+    if (_writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stop = true;
+        }
+        _frameReady.notify_one();
+        _writer.join();
+    }
+
+    if (_file)
+    {
+        if (fclose(_file) != 0 && _error.empty())
+            _error = "Cannot write recording " + _path;
+        _file = NULL;
+    }
+
+    for (size_t i = 0; i < _pending.size(); ++i)
+        delete _pending[i];
+    _pending.clear();
+    for (size_t i = 0; i < _spare.size(); ++i)
+        delete _spare[i];
+    _spare.clear();
+}
+
+void frameRecorder::writerMain()
+{
+    std::vector<unsigned char> encoded;
+    for (;;)
+    {
+        frame* f;
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _frameReady.wait(guard, [this] { return _stop || !_pending.empty(); });
+            if (_pending.empty())
+                return;
+            f = _pending.front();
+        }
+
+        // The frame stays queued while it's written to bound the memory.
+        encodeFrame(f->words, _previous, encoded);
+        const StoredSize header[2] = { f->step, encoded.size() };
+        const bool written = fwrite(header, sizeof(header), 1, _file) == 1 &&
+            fwrite(&encoded[0], 1, encoded.size(), _file) == encoded.size();
+        _previous.swap(f->words);
+
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _pending.pop_front();
+            _spare.push_back(f);
+            if (!written)
+                _error = "Cannot write recording " + _path;
+        }
+        _frameWritten.notify_one();
+        if (!written)
+            return;
+    }
+}
+
+frameReader::frameReader(const char* path) :
+    _file(NULL), _path(path), _width(0), _height(0), _step(0)
+{
+    _file = fopen(path, "rb");
+    if (!_file)
+        throw std::runtime_error("Cannot open recording " + _path);
+
+    try {
+        char magic[sizeof(RECORDING_MAGIC)];
+        uint32_t version, byte_order;
+        StoredSize dims[2];
+        read(magic, sizeof(magic));
+        if (memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0)
+            throw std::runtime_error(_path + " is not a recording");
+        read(&version, sizeof(version));
+        if (version != RECORDING_VERSION)
+            throw std::runtime_error(_path + " is a recording of another version");
+        read(&byte_order, sizeof(byte_order));
+        if (byte_order != RECORDING_BYTE_ORDER_MARK)
+            throw std::runtime_error(_path + " is from a machine of another byte order");
+        read(dims, sizeof(dims));
+
+        _width = (size_t)dims[0];
+        _height = (size_t)dims[1];
+        if (_width == 0 || _height == 0 || _width != dims[0] ||
+            _height != dims[1] || _width * _height / _height != _width)
+            throw std::runtime_error(_path + " has an invalid map size");
+    } catch (...) {
+        fclose(_file);
+        throw;
+    }
+
+    const size_t area = _width * _height;
+    _words.assign(2 * area, 0);
+    _topography.resize(area);
+    _plates.resize(area);
+}
+
+frameReader::~frameReader() throw()
+{
+    fclose(_file);
+}
+
+void frameReader::read(void* data, size_t bytes)
+{
+    if (fread(data, 1, bytes, _file) != bytes)
+        throw std::runtime_error("Recording " + _path + " is truncated");
+}
+
+bool frameReader::next()
+{
+    StoredSize header[2];
+    const size_t got = fread(header, 1, sizeof(header), _file);
+    if (got == 0 && feof(_file))
+        return false;
+    if (got != sizeof(header))
+        throw std::runtime_error("Recording " + _path + " is truncated");
+
+    // No frame is larger than its words plus two run lengths per word.
+    const size_t n = _words.size();
+    if (header[1] > n * (sizeof(uint32_t) + 2 * 10))
+        throw std::runtime_error("Recording " + _path + " is corrupt");
+    _encoded.resize((size_t)header[1]);
+    if (!_encoded.empty())
+        read(&_encoded[0], _encoded.size());
+
+    const unsigned char* in = _encoded.empty() ? NULL : &_encoded[0];
+    const unsigned char* const end = in + _encoded.size();
+    for (size_t i = 0; i < n; )
+    {
+        size_t same, diff;
+        if (!getVarint(in, end, same) || !getVarint(in, end, diff) ||
+            same + diff == 0 || same > n - i || diff > n - i - same ||
+            (size_t)(end - in) < diff * sizeof(uint32_t))
+            throw std::runtime_error("Recording " + _path + " is corrupt");
+
+        i += same;
+        for (size_t j = 0; j < diff; ++j, ++i, in += sizeof(uint32_t))
+        {
+            uint32_t x;
+            memcpy(&x, in, sizeof(x));
+            _words[i] ^= x;
+        }
+    }
+    if (in != end)
+        throw std::runtime_error("Recording " + _path + " is corrupt");
+
+    _step = header[0];
+    const size_t area = _topography.size();
+    memcpy(&_topography[0], &_words[0], area * sizeof(float));
+    for (size_t i = 0; i < area; ++i)
+        _plates[i] = _words[area + i] == NO_PLATE ? (size_t)-1 : _words[area + i];
+    return true;
+}
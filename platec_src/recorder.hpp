@@ -0,0 +1,130 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include "utils.hpp"
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Appends frames of a running simulation to a file on a thread of its own.
+ *
+ * A frame is the height map and plate index map after a step. Each frame
+ * is stored as the XOR of its 32-bit words with those of the previous one,
+ * run-length encoded, so that areas which didn't change take almost no
+ * space. The simulation only copies the maps into a spare buffer; encoding
+ * and writing happen on the recorder's thread. Once a few frames are
+ * waiting, add() blocks until the writer has caught up.
+ *
+ * The file starts like a checkpoint with a magic string ("PLATECFR"), the
+ * version and a byte order mark, followed by the width and height. Each
+ * frame is its step number, the size of its encoded data and the data:
+ * pairs of run lengths of unchanged and changed words, both as unsigned
+ * LEB128, each followed by the changed words XORed with the previous
+ * frame. The words are the bits of the heights followed by the plate
+ * indices, with 0xffffffff for no plate.
+ */
+class frameRecorder
+{
+  public:
+
+	/**
+	 * Create the file and start the writer.
+	 *
+	 * @param interval Record the steps that are multiples of this.
+	 * @exception	runtime_error Exception is thrown if the file can't be
+	 *           	created.
+	 * @exception	invalid_argument Exception is thrown if the interval is
+	 *           	zero.
+	 */
+	frameRecorder(const char* path, size_t width, size_t height,
+	              size_t interval);
+
+	~frameRecorder() throw(); ///< Write the remaining frames and close.
+
+	/// Queue the maps after a step if it's one to record. Does nothing
+	/// once writing has failed; the error is reported by close().
+	void add(size_t step, const float* heights, const size_t* plates);
+
+	/// Write the remaining frames and close the file.
+	/// @exception runtime_error Thrown if any frame couldn't be written.
+	void close();
+
+  private:
+
+	class frame
+	{
+	  public:
+		unsigned long long step;
+		std::vector<uint32_t> words;
+	};
+
+	frameRecorder(const frameRecorder&);
+	frameRecorder& operator=(const frameRecorder&);
+
+	void finish() throw(); ///< Stop the writer and close the file.
+	void writerMain();
+
+	FILE* _file;
+	const std::string _path;
+	const size_t _area;     ///< Number of points in a map.
+	const size_t _interval; ///< Steps between recorded frames.
+	std::vector<uint32_t> _previous; ///< Words of the last frame written.
+
+	std::thread _writer;
+	std::mutex _lock;
+	std::condition_variable _frameReady;   ///< A frame has been queued.
+	std::condition_variable _frameWritten; ///< A queued frame is done.
+	std::deque<frame*> _pending; ///< Frames not yet written, oldest first.
+	std::vector<frame*> _spare;  ///< Buffers of written frames.
+	std::string _error;          ///< Why writing failed, if it did.
+	bool _stop;                  ///< Exit after writing pending frames.
+};
+
+/// Reads the frames written by frameRecorder in order.
+class frameReader
+{
+  public:
+
+	/// @exception runtime_error Thrown if the file can't be opened or
+	///            isn't a recording of a supported version.
+	explicit frameReader(const char* path);
+	~frameReader() throw();
+
+	/**
+	 * Decode the next frame.
+	 *
+	 * @return False if all frames have already been read.
+	 * @exception	runtime_error Exception is thrown if the file is
+	 *           	truncated or corrupt.
+	 */
+	bool next();
+
+	unsigned long long getStep() const throw() { return _step; }
+	const float* getTopography() const throw() { return &_topography[0]; }
+	const size_t* getPlatesMap() const throw() { return &_plates[0]; }
+	size_t getWidth() const throw() { return _width; }
+	size_t getHeight() const throw() { return _height; }
+
+  private:
+
+	frameReader(const frameReader&);
+	frameReader& operator=(const frameReader&);
+
+	void read(void* data, size_t bytes);
+
+	FILE* _file;
+	const std::string _path;
+	size_t _width, _height;
+	unsigned long long _step; ///< Step of the current frame.
+	std::vector<uint32_t> _words; ///< Words of the current frame.
+	std::vector<unsigned char> _encoded;
+	std::vector<float> _topography;
+	std::vector<size_t> _plates;
+};
+
+#endif
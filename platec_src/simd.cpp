@@ -0,0 +1,78 @@
+#include "simd.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(PLATEC_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace Platec {
+
+static SimdLevel detectSimdLevel()
+{
+#if defined(PLATEC_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SIMD_SSE41;
+#elif defined(PLATEC_SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+
+    // The OS must save the upper halves of the vector registers too.
+    unsigned long long xcr0 = 0;
+    if (osxsave)
+        xcr0 = _xgetbv(0);
+    const bool ymm_saved = (xcr0 & 0x06) == 0x06;
+    const bool zmm_saved = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false, avx512 = false;
+    if (max_leaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0;
+    }
+
+    if (avx && avx512 && zmm_saved)
+        return SIMD_AVX512;
+    if (avx && avx2 && ymm_saved)
+        return SIMD_AVX2;
+    if (sse41)
+        return SIMD_SSE41;
+#endif
+    return SIMD_SCALAR;
+}
+
+static SimdLevel simdLevelLimit()
+{
+    const char* env = getenv("PLATEC_SIMD");
+    if (env == NULL)
+        return SIMD_AVX512;
+    if (strcmp(env, "avx2") == 0)
+        return SIMD_AVX2;
+    if (strcmp(env, "sse41") == 0)
+        return SIMD_SSE41;
+    if (strcmp(env, "scalar") == 0)
+        return SIMD_SCALAR;
+    return SIMD_AVX512;
+}
+
+SimdLevel simdLevel()
+{
+    static const SimdLevel detected = detectSimdLevel();
+    static const SimdLevel limit = simdLevelLimit();
+    return detected < limit ? detected : limit;
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+// Vector kernels are only built for 64-bit x86, where size_t is 64 bits wide
+// and SSE2 is part of the baseline instruction set.
+#if defined(__x86_64__) || defined(_M_X64)
+#define PLATEC_SIMD_X86 1
+#endif
+
+#if defined(PLATEC_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PLATEC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PLATEC_TARGET(isa)
+#endif
+
+#if defined(_MSC_VER)
+#define PLATEC_ALIGN16 __declspec(align(16))
+#else
+#define PLATEC_ALIGN16 __attribute__((aligned(16)))
+#endif
+
+namespace Platec {
+
+/// Instruction set extensions usable by the vector kernels, in increasing
+/// order of capability.
+enum SimdLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE41,
+	SIMD_AVX2,
+	SIMD_AVX512
+};
+
+/// Return the best instruction set supported by both CPU and OS.
+///
+/// Detection is done once. The environment variable PLATEC_SIMD (one of
+/// "scalar", "sse41", "avx2" or "avx512") can be used to cap the level,
+/// e.g. to compare the kernels against each other.
+SimdLevel simdLevel();
+
+}
+
+#endif
@@ -7,8 +7,13 @@
  */
 
 #include "simplerandom.hpp"
+#include "simd.hpp"
 #include <stddef.h>
 
+#ifdef PLATEC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 #ifndef UINT32_C
 #define UINT32_C(val) val##ui32
 #endif
@@ -19,18 +24,17 @@ uint32_t simplerandom_cong_next(SimpleRandomCong_t * p_cong);
 
 SimpleRandom::SimpleRandom(uint32_t seed)
 {
-    this->internal = new SimpleRandomCong_t();
-    simplerandom_cong_seed(this->internal, seed);
+    simplerandom_cong_seed(&this->internal, seed);
 }
 
-SimpleRandom::~SimpleRandom()
+void SimpleRandom::seed(uint32_t seed)
 {
-    delete this->internal;
+    simplerandom_cong_seed(&this->internal, seed);
 }
     
 uint32_t SimpleRandom::next()
 {
-    uint32_t res = simplerandom_cong_next(this->internal);
+    uint32_t res = simplerandom_cong_next(&this->internal);
     
     return res;
 }
@@ -40,6 +44,66 @@ double SimpleRandom::next_double()
     return ((double)next() / (double)maximum());
 }
 
+#ifdef PLATEC_SIMD_X86
+
+// Eight consecutive numbers at a time: each lane jumps eight steps ahead.
+// Every number is divided by the maximum in double precision like in
+// next_double(), so the results are identical. Returns the count filled.
+PLATEC_TARGET("avx2")
+static size_t fillAVX2(uint32_t* cong, float* values, size_t count)
+{
+    if (count < 8)
+        return 0;
+
+    // x[n + k] = a_k * x[n] + c_k
+    uint32_t a[9], c[9];
+    a[0] = 1; c[0] = 0;
+    for (int k = 1; k <= 8; ++k) {
+        a[k] = UINT32_C(69069) * a[k - 1];
+        c[k] = UINT32_C(69069) * c[k - 1] + 12345u;
+    }
+
+    const uint32_t x = *cong;
+    __m256i state = _mm256_setr_epi32(
+        a[1] * x + c[1], a[2] * x + c[2], a[3] * x + c[3], a[4] * x + c[4],
+        a[5] * x + c[5], a[6] * x + c[6], a[7] * x + c[7], a[8] * x + c[8]);
+    const __m256i mul = _mm256_set1_epi32((int)a[8]);
+    const __m256i add = _mm256_set1_epi32((int)c[8]);
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    const __m256d offset = _mm256_set1_pd(2147483648.0);
+    const __m256d maximum = _mm256_set1_pd(4294967295.0);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // Unsigned to double: flip the sign bit and add it back exactly.
+        const __m128i lo = _mm_xor_si128(_mm256_castsi256_si128(state), sign);
+        const __m128i hi = _mm_xor_si128(_mm256_extracti128_si256(state, 1), sign);
+        const __m256d dlo = _mm256_add_pd(_mm256_cvtepi32_pd(lo), offset);
+        const __m256d dhi = _mm256_add_pd(_mm256_cvtepi32_pd(hi), offset);
+        _mm_storeu_ps(&values[i], _mm256_cvtpd_ps(_mm256_div_pd(dlo, maximum)));
+        _mm_storeu_ps(&values[i + 4], _mm256_cvtpd_ps(_mm256_div_pd(dhi, maximum)));
+
+        *cong = (uint32_t)_mm256_extract_epi32(state, 7);
+        state = _mm256_add_epi32(_mm256_mullo_epi32(state, mul), add);
+    }
+
+    return i;
+}
+
+#endif
+
+void SimpleRandom::fill(float* values, size_t count)
+{
+    size_t i = 0;
+#ifdef PLATEC_SIMD_X86
+    if (Platec::simdLevel() >= Platec::SIMD_AVX2)
+        i = fillAVX2(&this->internal.cong, values, count);
+#endif
+    for (; i < count; ++i)
+        values[i] = (float)next_double();
+}
+
 int32_t SimpleRandom::next_signed()
 {
     int32_t value = (int32_t)next();
@@ -10,6 +10,7 @@
 #define SIMPLE_RANDOM_HPP
 
 #include "utils.hpp"
+#include <cstddef>
 
 typedef struct
 {
@@ -20,13 +21,16 @@ typedef struct
 class SimpleRandom {
 public:
 	SimpleRandom(uint32_t seed);
-	~SimpleRandom();
+	void seed(uint32_t seed); ///< Restart the sequence from a new seed.
 	uint32_t next();
 	int32_t next_signed();
 	double next_double();
+	void fill(float* values, size_t count); ///< Same as count (float)next_double().
 	uint32_t maximum();
+	uint32_t getState() const { return internal.cong; } ///< For checkpoints.
+	void setState(uint32_t state) { internal.cong = state; }
 private:
-	SimpleRandomCong_t* internal;
+	SimpleRandomCong_t internal; ///< Copies of the generator are independent.
 };
 
 #endif
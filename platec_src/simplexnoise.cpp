@@ -21,8 +21,16 @@
 #endif
 #include <math.h>
 #include <cstdlib>
+#include <stdint.h>
+#include <vector>
 
 #include "simplexnoise.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+#ifdef PLATEC_SIMD_X86
+#include <immintrin.h>
+#endif
 
 
 /* 2D, 3D and 4D Simplex Noise functions return 'random' values in (-1, 1).
@@ -50,24 +58,62 @@ all look identical.
 */
 
 
+// Number of octaves that have to be evaluated so that the amplitudes of the
+// skipped ones add up to no more than tolerance times the amplitude of all
+// of them. That total, which the noise is divided by, is stored in
+// maxAmplitude. A zero tolerance evaluates every octave.
+int significant_octaves( const float octaves, const float persistence, const float tolerance, float& maxAmplitude ) {
+    float amplitude = 1;
+    int count = 0;
+
+    // We have to keep track of the largest possible amplitude,
+    // because each octave adds more, and we need a value in [-1, 1].
+    maxAmplitude = 0;
+    for( int i=0; i < octaves; i++ ) {
+        maxAmplitude += amplitude;
+        amplitude *= persistence;
+        count++;
+    }
+
+    if (tolerance <= 0)
+        return count;
+
+    // The sums are in double so that the tail doesn't vanish in rounding.
+    double remaining = 0;
+    amplitude = 1;
+    for( int i=0; i < count; i++ ) {
+        remaining += amplitude;
+        amplitude *= persistence;
+    }
+
+    const double limit = tolerance * remaining;
+    amplitude = 1;
+    int used = 0;
+    while (used < count && remaining > limit) {
+        remaining -= amplitude;
+        amplitude *= persistence;
+        used++;
+    }
+
+    return used;
+}
+
+
 // 2D Multi-octave Simplex noise.
 //
 // For each octave, a higher frequency/lower amplitude function will be added to the original.
 // The higher the persistence [0-1], the more of each succeeding octave will be added.
-float octave_noise_2d( const float octaves, const float persistence, const float scale, const float x, const float y ) {
+float octave_noise_2d( const float octaves, const float persistence, const float scale, const float x, const float y, const float tolerance ) {
     float total = 0;
     float frequency = scale;
     float amplitude = 1;
+    float maxAmplitude;
+    const int count = significant_octaves(octaves, persistence, tolerance, maxAmplitude);
 
-    // We have to keep track of the largest possible amplitude,
-    // because each octave adds more, and we need a value in [-1, 1].
-    float maxAmplitude = 0;
-
-    for( int i=0; i < octaves; i++ ) {
+    for( int i=0; i < count; i++ ) {
         total += raw_noise_2d( x * frequency, y * frequency ) * amplitude;
 
         frequency *= 2;
-        maxAmplitude += amplitude;
         amplitude *= persistence;
     }
 
@@ -79,20 +125,17 @@ float octave_noise_2d( const float octaves, const float persistence, const float
 //
 // For each octave, a higher frequency/lower amplitude function will be added to the original.
 // The higher the persistence [0-1], the more of each succeeding octave will be added.
-float octave_noise_3d( const float octaves, const float persistence, const float scale, const float x, const float y, const float z ) {
+float octave_noise_3d( const float octaves, const float persistence, const float scale, const float x, const float y, const float z, const float tolerance ) {
     float total = 0;
     float frequency = scale;
     float amplitude = 1;
+    float maxAmplitude;
+    const int count = significant_octaves(octaves, persistence, tolerance, maxAmplitude);
 
-    // We have to keep track of the largest possible amplitude,
-    // because each octave adds more, and we need a value in [-1, 1].
-    float maxAmplitude = 0;
-
-    for( int i=0; i < octaves; i++ ) {
+    for( int i=0; i < count; i++ ) {
         total += raw_noise_3d( x * frequency, y * frequency, z * frequency ) * amplitude;
 
         frequency *= 2;
-        maxAmplitude += amplitude;
         amplitude *= persistence;
     }
 
@@ -104,20 +147,17 @@ float octave_noise_3d( const float octaves, const float persistence, const float
 //
 // For each octave, a higher frequency/lower amplitude function will be added to the original.
 // The higher the persistence [0-1], the more of each succeeding octave will be added.
-float octave_noise_4d( const float octaves, const float persistence, const float scale, const float x, const float y, const float z, const float w ) {
+float octave_noise_4d( const float octaves, const float persistence, const float scale, const float x, const float y, const float z, const float w, const float tolerance ) {
     float total = 0;
     float frequency = scale;
     float amplitude = 1;
+    float maxAmplitude;
+    const int count = significant_octaves(octaves, persistence, tolerance, maxAmplitude);
 
-    // We have to keep track of the largest possible amplitude,
-    // because each octave adds more, and we need a value in [-1, 1].
-    float maxAmplitude = 0;
-
-    for( int i=0; i < octaves; i++ ) {
+    for( int i=0; i < count; i++ ) {
         total += raw_noise_4d( x * frequency, y * frequency, z * frequency, w * frequency ) * amplitude;
 
         frequency *= 2;
-        maxAmplitude += amplitude;
         amplitude *= persistence;
     }
 
@@ -129,23 +169,23 @@ float octave_noise_4d( const float octaves, const float persistence, const float
 // 2D Scaled Multi-octave Simplex noise.
 //
 // Returned value will be between loBound and hiBound.
-float scaled_octave_noise_2d( const float octaves, const float persistence, const float scale, const float loBound, const float hiBound, const float x, const float y ) {
-    return octave_noise_2d(octaves, persistence, scale, x, y) * (hiBound - loBound) / 2 + (hiBound + loBound) / 2;
+float scaled_octave_noise_2d( const float octaves, const float persistence, const float scale, const float loBound, const float hiBound, const float x, const float y, const float tolerance ) {
+    return octave_noise_2d(octaves, persistence, scale, x, y, tolerance) * (hiBound - loBound) / 2 + (hiBound + loBound) / 2;
 }
 
 
 // 3D Scaled Multi-octave Simplex noise.
 //
 // Returned value will be between loBound and hiBound.
-float scaled_octave_noise_3d( const float octaves, const float persistence, const float scale, const float loBound, const float hiBound, const float x, const float y, const float z ) {
-    return octave_noise_3d(octaves, persistence, scale, x, y, z) * (hiBound - loBound) / 2 + (hiBound + loBound) / 2;
+float scaled_octave_noise_3d( const float octaves, const float persistence, const float scale, const float loBound, const float hiBound, const float x, const float y, const float z, const float tolerance ) {
+    return octave_noise_3d(octaves, persistence, scale, x, y, z, tolerance) * (hiBound - loBound) / 2 + (hiBound + loBound) / 2;
 }
 
 // 4D Scaled Multi-octave Simplex noise.
 //
 // Returned value will be between loBound and hiBound.
-float scaled_octave_noise_4d( const float octaves, const float persistence, const float scale, const float loBound, const float hiBound, const float x, const float y, const float z, const float w ) {
-    return octave_noise_4d(octaves, persistence, scale, x, y, z, w) * (hiBound - loBound) / 2 + (hiBound + loBound) / 2;
+float scaled_octave_noise_4d( const float octaves, const float persistence, const float scale, const float loBound, const float hiBound, const float x, const float y, const float z, const float w, const float tolerance ) {
+    return octave_noise_4d(octaves, persistence, scale, x, y, z, w, tolerance) * (hiBound - loBound) / 2 + (hiBound + loBound) / 2;
 }
 
 
@@ -338,12 +378,49 @@ float raw_noise_3d( const float x, const float y, const float z ) {
 }
 
 
+namespace {
+
+// Compact copies of perm and grad4 for the 4D noise. permMod32 already holds
+// the gradient index of the last lookup, so no masking is needed.
+struct NoiseTables
+{
+    uint8_t perm[512];
+    uint8_t permMod32[512];
+    int8_t grad4[32][4];
+
+    NoiseTables()
+    {
+        for (int i = 0; i < 512; ++i) {
+            perm[i] = (uint8_t)::perm[i];
+            permMod32[i] = (uint8_t)(::perm[i] % 32);
+        }
+        for (int i = 0; i < 32; ++i)
+            for (int j = 0; j < 4; ++j)
+                grad4[i][j] = (int8_t)::grad4[i][j];
+    }
+};
+
+const NoiseTables tables;
+
+// Contribution of one simplex corner.
+inline float corner_4d(const float x, const float y, const float z, const float w,
+                       const int ii, const int jj, const int kk, const int ll)
+{
+    const int8_t* g = tables.grad4[tables.permMod32[
+        ii + tables.perm[jj + tables.perm[kk + tables.perm[ll]]]]];
+    const float t = 0.6 - x*x - y*y - z*z - w*w;
+    const float t2 = t * t;
+    const float n = t2 * t2 * (g[0]*x + g[1]*y + g[2]*z + g[3]*w);
+    return t < 0 ? 0.0f : n;
+}
+
+}
+
 // 4D raw Simplex noise
 float raw_noise_4d( const float x, const float y, const float z, const float w ) {
     // The skewing and unskewing factors are hairy again for the 4D case
     float F4 = (sqrtf(5.0)-1.0)/4.0;
     float G4 = (5.0-sqrtf(5.0))/20.0;
-    float n0, n1, n2, n3, n4; // Noise contributions from the five corners
 
     // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
     float s = (x + y + z + w) * F4; // Factor for 4D skewing
@@ -364,43 +441,22 @@ float raw_noise_4d( const float x, const float y, const float z, const float w )
 
     // For the 4D case, the simplex is a 4D shape I won't even try to describe.
     // To find out which of the 24 possible simplices we're in, we need to
-    // determine the magnitude ordering of x0, y0, z0 and w0.
-    // The method below is a good way of finding the ordering of x,y,z,w and
-    // then find the correct traversal order for the simplex we're in.
-    // First, six pair-wise comparisons are performed between each possible pair
-    // of the four coordinates, and the results are used to add up binary bits
-    // for an integer index.
-    int c1 = (x0 > y0) ? 32 : 0;
-    int c2 = (x0 > z0) ? 16 : 0;
-    int c3 = (y0 > z0) ? 8 : 0;
-    int c4 = (x0 > w0) ? 4 : 0;
-    int c5 = (y0 > w0) ? 2 : 0;
-    int c6 = (z0 > w0) ? 1 : 0;
-    int c = c1 + c2 + c3 + c4 + c5 + c6;
-
-    int i1, j1, k1, l1; // The integer offsets for the second simplex corner
-    int i2, j2, k2, l2; // The integer offsets for the third simplex corner
-    int i3, j3, k3, l3; // The integer offsets for the fourth simplex corner
-
-    // simplex[c] is a 4-vector with the numbers 0, 1, 2 and 3 in some order.
-    // Many values of c will never occur, since e.g. x>y>z>w makes x<z, y<w and x<w
-    // impossible. Only the 24 indices which have non-zero entries make any sense.
+    // determine the magnitude ordering of x0, y0, z0 and w0. Each coordinate's
+    // rank counts the coordinates it beats; of two equal coordinates the later
+    // one wins. This is the ordering the "simplex" table encodes.
+    int xy = x0 > y0, xz = x0 > z0, xw = x0 > w0;
+    int yz = y0 > z0, yw = y0 > w0, zw = z0 > w0;
+    int rx = xy + xz + xw;
+    int ry = 1 - xy + yz + yw;
+    int rz = 2 - xz - yz + zw;
+    int rw = 3 - xw - yw - zw;
+
     // We use a thresholding to set the coordinates in turn from the largest magnitude.
-    // The number 3 in the "simplex" array is at the position of the largest coordinate.
-    i1 = simplex[c][0]>=3 ? 1 : 0;
-    j1 = simplex[c][1]>=3 ? 1 : 0;
-    k1 = simplex[c][2]>=3 ? 1 : 0;
-    l1 = simplex[c][3]>=3 ? 1 : 0;
-    // The number 2 in the "simplex" array is at the second largest coordinate.
-    i2 = simplex[c][0]>=2 ? 1 : 0;
-    j2 = simplex[c][1]>=2 ? 1 : 0;
-    k2 = simplex[c][2]>=2 ? 1 : 0;
-    l2 = simplex[c][3]>=2 ? 1 : 0;
-    // The number 1 in the "simplex" array is at the second smallest coordinate.
-    i3 = simplex[c][0]>=1 ? 1 : 0;
-    j3 = simplex[c][1]>=1 ? 1 : 0;
-    k3 = simplex[c][2]>=1 ? 1 : 0;
-    l3 = simplex[c][3]>=1 ? 1 : 0;
+    // The second corner is offset along the largest coordinate, the third
+    // along the two largest and the fourth along all but the smallest.
+    int i1 = rx >= 3, j1 = ry >= 3, k1 = rz >= 3, l1 = rw >= 3;
+    int i2 = rx >= 2, j2 = ry >= 2, k2 = rz >= 2, l2 = rw >= 2;
+    int i3 = rx >= 1, j3 = ry >= 1, k3 = rz >= 1, l3 = rw >= 1;
     // The fifth corner has all coordinate offsets = 1, so no need to look that up.
 
     float x1 = x0 - i1 + G4; // Offsets for second corner in (x,y,z,w) coords
@@ -420,52 +476,16 @@ float raw_noise_4d( const float x, const float y, const float z, const float w )
     float z4 = z0 - 1.0 + 4.0*G4;
     float w4 = w0 - 1.0 + 4.0*G4;
 
-    // Work out the hashed gradient indices of the five simplex corners
+    // Calculate the contribution from the five corners
     int ii = i & 255;
     int jj = j & 255;
     int kk = k & 255;
     int ll = l & 255;
-    int gi0 = perm[ii+perm[jj+perm[kk+perm[ll]]]] % 32;
-    int gi1 = perm[ii+i1+perm[jj+j1+perm[kk+k1+perm[ll+l1]]]] % 32;
-    int gi2 = perm[ii+i2+perm[jj+j2+perm[kk+k2+perm[ll+l2]]]] % 32;
-    int gi3 = perm[ii+i3+perm[jj+j3+perm[kk+k3+perm[ll+l3]]]] % 32;
-    int gi4 = perm[ii+1+perm[jj+1+perm[kk+1+perm[ll+1]]]] % 32;
-
-    // Calculate the contribution from the five corners
-    float t0 = 0.6 - x0*x0 - y0*y0 - z0*z0 - w0*w0;
-    if(t0<0) n0 = 0.0;
-    else {
-        t0 *= t0;
-        n0 = t0 * t0 * dot(grad4[gi0], x0, y0, z0, w0);
-    }
-
-    float t1 = 0.6 - x1*x1 - y1*y1 - z1*z1 - w1*w1;
-    if(t1<0) n1 = 0.0;
-    else {
-        t1 *= t1;
-        n1 = t1 * t1 * dot(grad4[gi1], x1, y1, z1, w1);
-    }
-
-    float t2 = 0.6 - x2*x2 - y2*y2 - z2*z2 - w2*w2;
-    if(t2<0) n2 = 0.0;
-    else {
-        t2 *= t2;
-        n2 = t2 * t2 * dot(grad4[gi2], x2, y2, z2, w2);
-    }
-
-    float t3 = 0.6 - x3*x3 - y3*y3 - z3*z3 - w3*w3;
-    if(t3<0) n3 = 0.0;
-    else {
-        t3 *= t3;
-        n3 = t3 * t3 * dot(grad4[gi3], x3, y3, z3, w3);
-    }
-
-    float t4 = 0.6 - x4*x4 - y4*y4 - z4*z4 - w4*w4;
-    if(t4<0) n4 = 0.0;
-    else {
-        t4 *= t4;
-        n4 = t4 * t4 * dot(grad4[gi4], x4, y4, z4, w4);
-    }
+    float n0 = corner_4d(x0, y0, z0, w0, ii, jj, kk, ll);
+    float n1 = corner_4d(x1, y1, z1, w1, ii+i1, jj+j1, kk+k1, ll+l1);
+    float n2 = corner_4d(x2, y2, z2, w2, ii+i2, jj+j2, kk+k2, ll+l2);
+    float n3 = corner_4d(x3, y3, z3, w3, ii+i3, jj+j3, kk+k3, ll+l3);
+    float n4 = corner_4d(x4, y4, z4, w4, ii+1, jj+1, kk+1, ll+1);
 
     // Sum up and scale the result to cover the range [-1,1]
     return 27.0 * (n0 + n1 + n2 + n3 + n4);
@@ -480,38 +500,547 @@ float dot( const int* g, const float x, const float y, const float z, const floa
 
 #define PI 3.14159265
 
-int simplexnoise(long seed, float* map, int width, int height, float roughness)
+#ifdef PLATEC_SIMD_X86
+
+// The 4D noise below evaluates four points at a time with SSE2. It repeats
+// every operation of raw_noise_4d in the same order and precision. That
+// includes the steps C evaluates in double precision because of the double
+// constants mixed into float expressions. The results are therefore
+// bit-identical to the scalar functions.
+
+// fastfloor() of four values: one less than the truncation if x <= 0.
+static inline __m128i fastfloor_x4(__m128 x)
+{
+    const __m128 nonpositive = _mm_cmple_ps(x, _mm_setzero_ps());
+    return _mm_add_epi32(_mm_cvttps_epi32(x), _mm_castps_si128(nonpositive));
+}
+
+// (float)((double)x + c)
+static inline __m128 add_double_x4(__m128 x, double c)
+{
+    const __m128d vc = _mm_set1_pd(c);
+    const __m128d lo = _mm_add_pd(_mm_cvtps_pd(x), vc);
+    const __m128d hi = _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), vc);
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+// (float)((double)x - 1.0 + c)
+static inline __m128 sub_one_add_double_x4(__m128 x, double c)
+{
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d vc = _mm_set1_pd(c);
+    const __m128d lo = _mm_add_pd(_mm_sub_pd(_mm_cvtps_pd(x), one), vc);
+    const __m128d hi = _mm_add_pd(_mm_sub_pd(
+        _mm_cvtps_pd(_mm_movehl_ps(x, x)), one), vc);
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+// (float)(0.6 - x*x - y*y - z*z - w*w), squares in float, sums in double.
+static inline __m128d attenuation_half(__m128 xx, __m128 yy, __m128 zz, __m128 ww)
+{
+    __m128d t = _mm_sub_pd(_mm_set1_pd(0.6), _mm_cvtps_pd(xx));
+    t = _mm_sub_pd(t, _mm_cvtps_pd(yy));
+    t = _mm_sub_pd(t, _mm_cvtps_pd(zz));
+    return _mm_sub_pd(t, _mm_cvtps_pd(ww));
+}
+
+// Sign of each lane: 1.0f if the bit is clear, -1.0f if it's set.
+static inline __m128 sign_x4(__m128i bit)
+{
+    return _mm_or_ps(_mm_set1_ps(1.0f), _mm_castsi128_ps(_mm_slli_epi32(bit, 31)));
+}
+
+// Contribution of one simplex corner. gi holds the corner's grad4 indices:
+// bits 3-4 select the zero component and bits 2, 1 and 0 the signs of the
+// other three, in order.
+static inline __m128 corner_x4(__m128 x, __m128 y, __m128 z, __m128 w, __m128i gi)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i group = _mm_srli_epi32(gi, 3);
+    const __m128 g0 = _mm_castsi128_ps(_mm_cmpeq_epi32(group, _mm_setzero_si128()));
+    const __m128 g1 = _mm_castsi128_ps(_mm_cmpeq_epi32(group, one));
+    const __m128 g3 = _mm_castsi128_ps(_mm_cmpeq_epi32(group, _mm_set1_epi32(3)));
+    const __m128 g2 = _mm_andnot_ps(_mm_or_ps(_mm_or_ps(g0, g1), g3),
+                                    _mm_castsi128_ps(_mm_set1_epi32(-1)));
+    const __m128 sa = sign_x4(_mm_and_si128(_mm_srli_epi32(gi, 2), one));
+    const __m128 sb = sign_x4(_mm_and_si128(_mm_srli_epi32(gi, 1), one));
+    const __m128 sc = sign_x4(_mm_and_si128(gi, one));
+
+    const __m128 gx = _mm_andnot_ps(g0, sa);
+    const __m128 gy = _mm_or_ps(_mm_and_ps(g0, sa), _mm_and_ps(_mm_or_ps(g2, g3), sb));
+    const __m128 gz = _mm_or_ps(_mm_and_ps(_mm_or_ps(g0, g1), sb), _mm_and_ps(g3, sc));
+    const __m128 gw = _mm_andnot_ps(g3, sc);
+
+    const __m128 xx = _mm_mul_ps(x, x);
+    const __m128 yy = _mm_mul_ps(y, y);
+    const __m128 zz = _mm_mul_ps(z, z);
+    const __m128 ww = _mm_mul_ps(w, w);
+    const __m128d lo = attenuation_half(xx, yy, zz, ww);
+    const __m128d hi = attenuation_half(_mm_movehl_ps(xx, xx),
+        _mm_movehl_ps(yy, yy), _mm_movehl_ps(zz, zz), _mm_movehl_ps(ww, ww));
+    __m128 t = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+
+    __m128 dot = _mm_mul_ps(gx, x);
+    dot = _mm_add_ps(dot, _mm_mul_ps(gy, y));
+    dot = _mm_add_ps(dot, _mm_mul_ps(gz, z));
+    dot = _mm_add_ps(dot, _mm_mul_ps(gw, w));
+
+    const __m128 negative = _mm_cmplt_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    return _mm_andnot_ps(negative, _mm_mul_ps(_mm_mul_ps(t, t), dot));
+}
+
+// Offset of a corner along one axis: 1.0f where the rank is above limit.
+static inline __m128 offset_x4(__m128i rank, int limit)
+{
+    return _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(rank, _mm_set1_epi32(limit))),
+                      _mm_set1_ps(1.0f));
+}
+
+static __m128 raw_noise_4d_x4(__m128 x, __m128 y, __m128 z, __m128 w)
+{
+    const float F4 = (sqrtf(5.0)-1.0)/4.0;
+    const float G4 = (5.0-sqrtf(5.0))/20.0;
+    const __m128 vG4 = _mm_set1_ps(G4);
+
+    const __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(x, y), z), w),
+                                _mm_set1_ps(F4));
+    const __m128i i = fastfloor_x4(_mm_add_ps(x, s));
+    const __m128i j = fastfloor_x4(_mm_add_ps(y, s));
+    const __m128i k = fastfloor_x4(_mm_add_ps(z, s));
+    const __m128i l = fastfloor_x4(_mm_add_ps(w, s));
+    const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(
+        _mm_add_epi32(_mm_add_epi32(i, j), k), l)), vG4);
+
+    const __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+    const __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+    const __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+    const __m128 w0 = _mm_sub_ps(w, _mm_sub_ps(_mm_cvtepi32_ps(l), t));
+
+    // The rank of each coordinate among the four is what simplex[c] holds
+    // for the pair-wise comparisons encoded in c.
+    const __m128i xy = _mm_castps_si128(_mm_cmpgt_ps(x0, y0));
+    const __m128i xz = _mm_castps_si128(_mm_cmpgt_ps(x0, z0));
+    const __m128i yz = _mm_castps_si128(_mm_cmpgt_ps(y0, z0));
+    const __m128i xw = _mm_castps_si128(_mm_cmpgt_ps(x0, w0));
+    const __m128i yw = _mm_castps_si128(_mm_cmpgt_ps(y0, w0));
+    const __m128i zw = _mm_castps_si128(_mm_cmpgt_ps(z0, w0));
+
+    // Masks are -1 when set, so these subtract the number of wins.
+    const __m128i rx = _mm_sub_epi32(_mm_setzero_si128(),
+        _mm_add_epi32(_mm_add_epi32(xy, xz), xw));
+    const __m128i ry = _mm_sub_epi32(_mm_add_epi32(_mm_set1_epi32(1), xy),
+        _mm_add_epi32(yz, yw));
+    const __m128i rz = _mm_sub_epi32(_mm_add_epi32(_mm_set1_epi32(2),
+        _mm_add_epi32(xz, yz)), zw);
+    const __m128i rw = _mm_add_epi32(_mm_set1_epi32(3),
+        _mm_add_epi32(_mm_add_epi32(xw, yw), zw));
+
+    // Hash the gradients of the five corners lane by lane.
+    PLATEC_ALIGN16 int ri[4], rj[4], rk[4], rl[4];
+    PLATEC_ALIGN16 int ci[4], cj[4], ck[4], cl[4];
+    _mm_store_si128((__m128i*)ri, rx);
+    _mm_store_si128((__m128i*)rj, ry);
+    _mm_store_si128((__m128i*)rk, rz);
+    _mm_store_si128((__m128i*)rl, rw);
+    const __m128i mask = _mm_set1_epi32(255);
+    _mm_store_si128((__m128i*)ci, _mm_and_si128(i, mask));
+    _mm_store_si128((__m128i*)cj, _mm_and_si128(j, mask));
+    _mm_store_si128((__m128i*)ck, _mm_and_si128(k, mask));
+    _mm_store_si128((__m128i*)cl, _mm_and_si128(l, mask));
+
+    int gi[5][4];
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        const int ii = ci[lane], jj = cj[lane], kk = ck[lane], ll = cl[lane];
+        for (int c = 0; c < 5; ++c)
+        {
+            // Corner c is offset by one along the c largest coordinates.
+            const int i1 = ri[lane] >= 4 - c;
+            const int j1 = rj[lane] >= 4 - c;
+            const int k1 = rk[lane] >= 4 - c;
+            const int l1 = rl[lane] >= 4 - c;
+            gi[c][lane] = tables.permMod32[ii+i1+tables.perm[jj+j1+
+                tables.perm[kk+k1+tables.perm[ll+l1]]]];
+        }
+    }
+
+    __m128 n = corner_x4(x0, y0, z0, w0,
+        _mm_setr_epi32(gi[0][0], gi[0][1], gi[0][2], gi[0][3]));
+
+    const __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, offset_x4(rx, 2)), vG4);
+    const __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, offset_x4(ry, 2)), vG4);
+    const __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, offset_x4(rz, 2)), vG4);
+    const __m128 w1 = _mm_add_ps(_mm_sub_ps(w0, offset_x4(rw, 2)), vG4);
+    n = _mm_add_ps(n, corner_x4(x1, y1, z1, w1,
+        _mm_setr_epi32(gi[1][0], gi[1][1], gi[1][2], gi[1][3])));
+
+    const double G4x2 = 2.0*G4, G4x3 = 3.0*G4, G4x4 = 4.0*G4;
+    const __m128 x2 = add_double_x4(_mm_sub_ps(x0, offset_x4(rx, 1)), G4x2);
+    const __m128 y2 = add_double_x4(_mm_sub_ps(y0, offset_x4(ry, 1)), G4x2);
+    const __m128 z2 = add_double_x4(_mm_sub_ps(z0, offset_x4(rz, 1)), G4x2);
+    const __m128 w2 = add_double_x4(_mm_sub_ps(w0, offset_x4(rw, 1)), G4x2);
+    n = _mm_add_ps(n, corner_x4(x2, y2, z2, w2,
+        _mm_setr_epi32(gi[2][0], gi[2][1], gi[2][2], gi[2][3])));
+
+    const __m128 x3 = add_double_x4(_mm_sub_ps(x0, offset_x4(rx, 0)), G4x3);
+    const __m128 y3 = add_double_x4(_mm_sub_ps(y0, offset_x4(ry, 0)), G4x3);
+    const __m128 z3 = add_double_x4(_mm_sub_ps(z0, offset_x4(rz, 0)), G4x3);
+    const __m128 w3 = add_double_x4(_mm_sub_ps(w0, offset_x4(rw, 0)), G4x3);
+    n = _mm_add_ps(n, corner_x4(x3, y3, z3, w3,
+        _mm_setr_epi32(gi[3][0], gi[3][1], gi[3][2], gi[3][3])));
+
+    const __m128 x4 = sub_one_add_double_x4(x0, G4x4);
+    const __m128 y4 = sub_one_add_double_x4(y0, G4x4);
+    const __m128 z4 = sub_one_add_double_x4(z0, G4x4);
+    const __m128 w4 = sub_one_add_double_x4(w0, G4x4);
+    n = _mm_add_ps(n, corner_x4(x4, y4, z4, w4,
+        _mm_setr_epi32(gi[4][0], gi[4][1], gi[4][2], gi[4][3])));
+
+    // 27 * n is exact in double, so rounding it once in float is the same.
+    return _mm_mul_ps(_mm_set1_ps(27.0f), n);
+}
+
+static __m128 scaled_octave_noise_4d_x4(const int octaves,
+    const float maxAmplitude, const float persistence, const float scale,
+    const float loBound, const float hiBound,
+    __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    __m128 total = _mm_setzero_ps();
+    float frequency = scale;
+    float amplitude = 1;
+
+    for( int i=0; i < octaves; i++ ) {
+        const __m128 f = _mm_set1_ps(frequency);
+        const __m128 n = raw_noise_4d_x4(_mm_mul_ps(x, f), _mm_mul_ps(y, f),
+                                         _mm_mul_ps(z, f), _mm_mul_ps(w, f));
+        total = _mm_add_ps(total, _mm_mul_ps(n, _mm_set1_ps(amplitude)));
+
+        frequency *= 2;
+        amplitude *= persistence;
+    }
+
+    const __m128 v = _mm_div_ps(total, _mm_set1_ps(maxAmplitude));
+    return _mm_add_ps(
+        _mm_div_ps(_mm_mul_ps(v, _mm_set1_ps(hiBound - loBound)), _mm_set1_ps(2)),
+        _mm_set1_ps((hiBound + loBound) / 2));
+}
+
+// Same as the SSE2 version, eight points at a time. The hash is computed
+// with gathers from the permutation table.
+
+PLATEC_TARGET("avx2")
+static inline __m256i fastfloor_x8(__m256 x)
+{
+    const __m256 nonpositive = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LE_OQ);
+    return _mm256_add_epi32(_mm256_cvttps_epi32(x), _mm256_castps_si256(nonpositive));
+}
+
+PLATEC_TARGET("avx2")
+static inline __m256 add_double_x8(__m256 x, double c)
+{
+    const __m256d vc = _mm256_set1_pd(c);
+    const __m256d lo = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), vc);
+    const __m256d hi = _mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), vc);
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),
+                                _mm256_cvtpd_ps(hi), 1);
+}
+
+PLATEC_TARGET("avx2")
+static inline __m256 sub_one_add_double_x8(__m256 x, double c)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d vc = _mm256_set1_pd(c);
+    const __m256d lo = _mm256_add_pd(_mm256_sub_pd(
+        _mm256_cvtps_pd(_mm256_castps256_ps128(x)), one), vc);
+    const __m256d hi = _mm256_add_pd(_mm256_sub_pd(
+        _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), one), vc);
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),
+                                _mm256_cvtpd_ps(hi), 1);
+}
+
+PLATEC_TARGET("avx2")
+static inline __m128 attenuation_x4(__m128 xx, __m128 yy, __m128 zz, __m128 ww)
+{
+    __m256d t = _mm256_sub_pd(_mm256_set1_pd(0.6), _mm256_cvtps_pd(xx));
+    t = _mm256_sub_pd(t, _mm256_cvtps_pd(yy));
+    t = _mm256_sub_pd(t, _mm256_cvtps_pd(zz));
+    return _mm256_cvtpd_ps(_mm256_sub_pd(t, _mm256_cvtps_pd(ww)));
+}
+
+PLATEC_TARGET("avx2")
+static inline __m256 sign_x8(__m256i bit)
+{
+    return _mm256_or_ps(_mm256_set1_ps(1.0f),
+                        _mm256_castsi256_ps(_mm256_slli_epi32(bit, 31)));
+}
+
+PLATEC_TARGET("avx2")
+static inline __m256 corner_x8(__m256 x, __m256 y, __m256 z, __m256 w, __m256i gi)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i group = _mm256_srli_epi32(gi, 3);
+    const __m256 g0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(group, _mm256_setzero_si256()));
+    const __m256 g1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(group, one));
+    const __m256 g2 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(group, _mm256_set1_epi32(2)));
+    const __m256 g3 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(group, _mm256_set1_epi32(3)));
+    const __m256 sa = sign_x8(_mm256_and_si256(_mm256_srli_epi32(gi, 2), one));
+    const __m256 sb = sign_x8(_mm256_and_si256(_mm256_srli_epi32(gi, 1), one));
+    const __m256 sc = sign_x8(_mm256_and_si256(gi, one));
+
+    const __m256 gx = _mm256_andnot_ps(g0, sa);
+    const __m256 gy = _mm256_or_ps(_mm256_and_ps(g0, sa),
+                                   _mm256_and_ps(_mm256_or_ps(g2, g3), sb));
+    const __m256 gz = _mm256_or_ps(_mm256_and_ps(_mm256_or_ps(g0, g1), sb),
+                                   _mm256_and_ps(g3, sc));
+    const __m256 gw = _mm256_andnot_ps(g3, sc);
+
+    const __m256 xx = _mm256_mul_ps(x, x);
+    const __m256 yy = _mm256_mul_ps(y, y);
+    const __m256 zz = _mm256_mul_ps(z, z);
+    const __m256 ww = _mm256_mul_ps(w, w);
+    const __m128 lo = attenuation_x4(_mm256_castps256_ps128(xx),
+        _mm256_castps256_ps128(yy), _mm256_castps256_ps128(zz),
+        _mm256_castps256_ps128(ww));
+    const __m128 hi = attenuation_x4(_mm256_extractf128_ps(xx, 1),
+        _mm256_extractf128_ps(yy, 1), _mm256_extractf128_ps(zz, 1),
+        _mm256_extractf128_ps(ww, 1));
+    __m256 t = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+
+    __m256 dot = _mm256_mul_ps(gx, x);
+    dot = _mm256_add_ps(dot, _mm256_mul_ps(gy, y));
+    dot = _mm256_add_ps(dot, _mm256_mul_ps(gz, z));
+    dot = _mm256_add_ps(dot, _mm256_mul_ps(gw, w));
+
+    const __m256 negative = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_LT_OQ);
+    t = _mm256_mul_ps(t, t);
+    return _mm256_andnot_ps(negative, _mm256_mul_ps(_mm256_mul_ps(t, t), dot));
+}
+
+// One where the rank is above limit, zero elsewhere.
+PLATEC_TARGET("avx2")
+static inline __m256i offset_x8(__m256i rank, int limit)
+{
+    return _mm256_srli_epi32(_mm256_cmpgt_epi32(rank, _mm256_set1_epi32(limit)), 31);
+}
+
+PLATEC_TARGET("avx2")
+static inline __m256i hash_x8(__m256i ii, __m256i jj, __m256i kk, __m256i ll,
+    __m256i i1, __m256i j1, __m256i k1, __m256i l1)
+{
+    __m256i h = _mm256_i32gather_epi32(perm, _mm256_add_epi32(ll, l1), 4);
+    h = _mm256_i32gather_epi32(perm, _mm256_add_epi32(_mm256_add_epi32(kk, k1), h), 4);
+    h = _mm256_i32gather_epi32(perm, _mm256_add_epi32(_mm256_add_epi32(jj, j1), h), 4);
+    h = _mm256_i32gather_epi32(perm, _mm256_add_epi32(_mm256_add_epi32(ii, i1), h), 4);
+    return _mm256_and_si256(h, _mm256_set1_epi32(31));
+}
+
+PLATEC_TARGET("avx2")
+static __m256 raw_noise_4d_x8(__m256 x, __m256 y, __m256 z, __m256 w)
+{
+    const float F4 = (sqrtf(5.0)-1.0)/4.0;
+    const float G4 = (5.0-sqrtf(5.0))/20.0;
+    const __m256 vG4 = _mm256_set1_ps(G4);
+
+    const __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_add_ps(x, y), z), w), _mm256_set1_ps(F4));
+    const __m256i i = fastfloor_x8(_mm256_add_ps(x, s));
+    const __m256i j = fastfloor_x8(_mm256_add_ps(y, s));
+    const __m256i k = fastfloor_x8(_mm256_add_ps(z, s));
+    const __m256i l = fastfloor_x8(_mm256_add_ps(w, s));
+    const __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(
+        _mm256_add_epi32(_mm256_add_epi32(i, j), k), l)), vG4);
+
+    const __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+    const __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+    const __m256 z0 = _mm256_sub_ps(z, _mm256_sub_ps(_mm256_cvtepi32_ps(k), t));
+    const __m256 w0 = _mm256_sub_ps(w, _mm256_sub_ps(_mm256_cvtepi32_ps(l), t));
+
+    const __m256i xy = _mm256_castps_si256(_mm256_cmp_ps(x0, y0, _CMP_GT_OQ));
+    const __m256i xz = _mm256_castps_si256(_mm256_cmp_ps(x0, z0, _CMP_GT_OQ));
+    const __m256i yz = _mm256_castps_si256(_mm256_cmp_ps(y0, z0, _CMP_GT_OQ));
+    const __m256i xw = _mm256_castps_si256(_mm256_cmp_ps(x0, w0, _CMP_GT_OQ));
+    const __m256i yw = _mm256_castps_si256(_mm256_cmp_ps(y0, w0, _CMP_GT_OQ));
+    const __m256i zw = _mm256_castps_si256(_mm256_cmp_ps(z0, w0, _CMP_GT_OQ));
+
+    const __m256i rx = _mm256_sub_epi32(_mm256_setzero_si256(),
+        _mm256_add_epi32(_mm256_add_epi32(xy, xz), xw));
+    const __m256i ry = _mm256_sub_epi32(_mm256_add_epi32(_mm256_set1_epi32(1), xy),
+        _mm256_add_epi32(yz, yw));
+    const __m256i rz = _mm256_sub_epi32(_mm256_add_epi32(_mm256_set1_epi32(2),
+        _mm256_add_epi32(xz, yz)), zw);
+    const __m256i rw = _mm256_add_epi32(_mm256_set1_epi32(3),
+        _mm256_add_epi32(_mm256_add_epi32(xw, yw), zw));
+
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i ii = _mm256_and_si256(i, mask);
+    const __m256i jj = _mm256_and_si256(j, mask);
+    const __m256i kk = _mm256_and_si256(k, mask);
+    const __m256i ll = _mm256_and_si256(l, mask);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+
+    __m256 n = corner_x8(x0, y0, z0, w0,
+        hash_x8(ii, jj, kk, ll, zero, zero, zero, zero));
+
+    __m256i i1 = offset_x8(rx, 2), j1 = offset_x8(ry, 2);
+    __m256i k1 = offset_x8(rz, 2), l1 = offset_x8(rw, 2);
+    const __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i1)), vG4);
+    const __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j1)), vG4);
+    const __m256 z1 = _mm256_add_ps(_mm256_sub_ps(z0, _mm256_cvtepi32_ps(k1)), vG4);
+    const __m256 w1 = _mm256_add_ps(_mm256_sub_ps(w0, _mm256_cvtepi32_ps(l1)), vG4);
+    n = _mm256_add_ps(n, corner_x8(x1, y1, z1, w1,
+        hash_x8(ii, jj, kk, ll, i1, j1, k1, l1)));
+
+    const double G4x2 = 2.0*G4, G4x3 = 3.0*G4, G4x4 = 4.0*G4;
+    i1 = offset_x8(rx, 1), j1 = offset_x8(ry, 1);
+    k1 = offset_x8(rz, 1), l1 = offset_x8(rw, 1);
+    const __m256 x2 = add_double_x8(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i1)), G4x2);
+    const __m256 y2 = add_double_x8(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j1)), G4x2);
+    const __m256 z2 = add_double_x8(_mm256_sub_ps(z0, _mm256_cvtepi32_ps(k1)), G4x2);
+    const __m256 w2 = add_double_x8(_mm256_sub_ps(w0, _mm256_cvtepi32_ps(l1)), G4x2);
+    n = _mm256_add_ps(n, corner_x8(x2, y2, z2, w2,
+        hash_x8(ii, jj, kk, ll, i1, j1, k1, l1)));
+
+    i1 = offset_x8(rx, 0), j1 = offset_x8(ry, 0);
+    k1 = offset_x8(rz, 0), l1 = offset_x8(rw, 0);
+    const __m256 x3 = add_double_x8(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i1)), G4x3);
+    const __m256 y3 = add_double_x8(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j1)), G4x3);
+    const __m256 z3 = add_double_x8(_mm256_sub_ps(z0, _mm256_cvtepi32_ps(k1)), G4x3);
+    const __m256 w3 = add_double_x8(_mm256_sub_ps(w0, _mm256_cvtepi32_ps(l1)), G4x3);
+    n = _mm256_add_ps(n, corner_x8(x3, y3, z3, w3,
+        hash_x8(ii, jj, kk, ll, i1, j1, k1, l1)));
+
+    const __m256 x4 = sub_one_add_double_x8(x0, G4x4);
+    const __m256 y4 = sub_one_add_double_x8(y0, G4x4);
+    const __m256 z4 = sub_one_add_double_x8(z0, G4x4);
+    const __m256 w4 = sub_one_add_double_x8(w0, G4x4);
+    n = _mm256_add_ps(n, corner_x8(x4, y4, z4, w4,
+        hash_x8(ii, jj, kk, ll, one, one, one, one)));
+
+    return _mm256_mul_ps(_mm256_set1_ps(27.0f), n);
+}
+
+PLATEC_TARGET("avx2")
+static void scaled_octave_noise_4d_x8(const int octaves,
+    const float maxAmplitude, const float persistence, const float scale,
+    const float loBound, const float hiBound,
+    const float* x, const float* y, float z, float w, float* result)
+{
+    const __m256 vx = _mm256_loadu_ps(x);
+    const __m256 vy = _mm256_loadu_ps(y);
+    const __m256 vz = _mm256_set1_ps(z);
+    const __m256 vw = _mm256_set1_ps(w);
+    __m256 total = _mm256_setzero_ps();
+    float frequency = scale;
+    float amplitude = 1;
+
+    for( int i=0; i < octaves; i++ ) {
+        const __m256 f = _mm256_set1_ps(frequency);
+        const __m256 n = raw_noise_4d_x8(_mm256_mul_ps(vx, f), _mm256_mul_ps(vy, f),
+                                         _mm256_mul_ps(vz, f), _mm256_mul_ps(vw, f));
+        total = _mm256_add_ps(total, _mm256_mul_ps(n, _mm256_set1_ps(amplitude)));
+
+        frequency *= 2;
+        amplitude *= persistence;
+    }
+
+    const __m256 v = _mm256_div_ps(total, _mm256_set1_ps(maxAmplitude));
+    _mm256_storeu_ps(result, _mm256_add_ps(_mm256_div_ps(
+        _mm256_mul_ps(v, _mm256_set1_ps(hiBound - loBound)), _mm256_set1_ps(2)),
+        _mm256_set1_ps((hiBound + loBound) / 2)));
+}
+
+#endif
+
+int simplexnoise(long seed, float* map, int width, int height, float roughness,
+                 Platec::ThreadPool* pool, float tolerance)
 {
     float ka = 256/seed;
     float kb = seed*567%256;
     float kc = (seed*seed) % 256;
     float kd = (567-seed) % 256;
+    float noiseScale = 0.593;
+
+    // The first two coordinates only depend on the column and the last two
+    // on the row, so the sines and cosines are computed once per line.
+    std::vector<float> na(width), nb(width), nc(height), nd(height);
+    for (int x = 0; x < width; x++) {
+        float fNX = x/(float)width; // we let the x-offset define the circle
+        float fRdx = fNX*2*PI; // a full circle is two pi radians
+        float fRdsSin = 1.0f;
+        float a = fRdsSin*sinf(fRdx);
+        float b = fRdsSin*cosf(fRdx);
+        na[x] = ka+a*noiseScale;
+        nb[x] = kb+b*noiseScale;
+    }
     for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float fNX = x/(float)width; // we let the x-offset define the circle
-            float fNY = y/(float)height; // we let the x-offset define the circle
-            float fRdx = fNX*2*PI; // a full circle is two pi radians
-            float fRdy = fNY*4*PI; // a full circle is two pi radians
-            float fYSin = sinf(fRdy);
-            float fRdsSin = 1.0f;
-            float noiseScale = 0.593;
-            float a = fRdsSin*sinf(fRdx);
-            float b = fRdsSin*cosf(fRdx);
-            float c = fRdsSin*sinf(fRdy);
-            float d = fRdsSin*cosf(fRdy);
-            float v = scaled_octave_noise_4d(64.0f,
-                    roughness,
-                    2.0f,
-                    0.0f,
-                    1.0f,
-                    ka+a*noiseScale, 
-                    kb+b*noiseScale,
-                    kc+c*noiseScale,
-                    kd+d*noiseScale);          
-            if (map[y * width + x] == 0.0f) map[y * width + x] = v;          
-        }
+        float fNY = y/(float)height; // we let the x-offset define the circle
+        float fRdy = fNY*4*PI; // a full circle is two pi radians
+        float fRdsSin = 1.0f;
+        float c = fRdsSin*sinf(fRdy);
+        float d = fRdsSin*cosf(fRdy);
+        nc[y] = kc+c*noiseScale;
+        nd[y] = kd+d*noiseScale;
     }
 
+#ifdef PLATEC_SIMD_X86
+    const Platec::SimdLevel level = Platec::simdLevel();
+    float maxAmplitude;
+    const int octaves = significant_octaves(64.0f, roughness, tolerance, maxAmplitude);
+#endif
+
+    // Rows are independent. Every pixel's value depends only on its
+    // coordinates, so the result is the same however rows are distributed.
+    auto rows = [&](size_t first, size_t last)
+    {
+        for (int y = (int)first; y < (int)last; y++) {
+            int x = 0;
+#ifdef PLATEC_SIMD_X86
+            if (level >= Platec::SIMD_AVX2) {
+                for (; x + 8 <= width; x += 8) {
+                    float v[8];
+                    scaled_octave_noise_4d_x8(octaves, maxAmplitude,
+                        roughness, 2.0f, 0.0f, 1.0f, &na[x], &nb[x], nc[y], nd[y], v);
+                    for (int lane = 0; lane < 8; lane++)
+                        if (map[y * width + x + lane] == 0.0f)
+                            map[y * width + x + lane] = v[lane];
+                }
+            }
+            if (level != Platec::SIMD_SCALAR) {
+                const __m128 vc = _mm_set1_ps(nc[y]);
+                const __m128 vd = _mm_set1_ps(nd[y]);
+                for (; x + 4 <= width; x += 4) {
+                    PLATEC_ALIGN16 float v[4];
+                    _mm_store_ps(v, scaled_octave_noise_4d_x4(octaves,
+                        maxAmplitude, roughness, 2.0f, 0.0f, 1.0f,
+                        _mm_loadu_ps(&na[x]), _mm_loadu_ps(&nb[x]), vc, vd));
+                    for (int lane = 0; lane < 4; lane++)
+                        if (map[y * width + x + lane] == 0.0f)
+                            map[y * width + x + lane] = v[lane];
+                }
+            }
+#endif
+            for (; x < width; x++) {
+                float v = scaled_octave_noise_4d(64.0f,
+                        roughness,
+                        2.0f,
+                        0.0f,
+                        1.0f,
+                        na[x],
+                        nb[x],
+                        nc[y],
+                        nd[y],
+                        tolerance);
+                if (map[y * width + x] == 0.0f) map[y * width + x] = v;
+            }
+        }
+    };
+
+    if (pool)
+        pool->parallelFor(0, height, rows, 4);
+    else
+        rows(0, height);
+
     return 0;
 }
-
@@ -19,6 +19,8 @@
 #ifndef SIMPLEX_H_
 #define SIMPLEX_H_
 
+#include <cstddef> // For NULL.
+
 
 /* 2D, 3D and 4D Simplex Noise functions return 'random' values in (-1, 1).
 
@@ -48,24 +50,33 @@ all look identical.
 // Multi-octave Simplex noise
 // For each octave, a higher frequency/lower amplitude function will be added to the original.
 // The higher the persistence [0-1], the more of each succeeding octave will be added.
+// Octaves are skipped once the amplitude of all remaining ones is below tolerance
+// times the total amplitude. The default of zero evaluates all octaves.
 float octave_noise_2d(const float octaves,
                     const float persistence,
                     const float scale,
                     const float x,
-                    const float y);
+                    const float y,
+                    const float tolerance = 0.0f);
 float octave_noise_3d(const float octaves,
                     const float persistence,
                     const float scale,
                     const float x,
                     const float y,
-                    const float z);
+                    const float z,
+                    const float tolerance = 0.0f);
 float octave_noise_4d(const float octaves,
                     const float persistence,
                     const float scale,
                     const float x,
                     const float y,
                     const float z,
-                    const float w);
+                    const float w,
+                    const float tolerance = 0.0f);
+int significant_octaves(const float octaves,
+                    const float persistence,
+                    const float tolerance,
+                    float& maxAmplitude);
 
 
 // Scaled Multi-octave Simplex noise
@@ -76,7 +87,8 @@ float scaled_octave_noise_2d(  const float octaves,
                             const float loBound,
                             const float hiBound,
                             const float x,
-                            const float y);
+                            const float y,
+                            const float tolerance = 0.0f);
 float scaled_octave_noise_3d(  const float octaves,
                             const float persistence,
                             const float scale,
@@ -84,7 +96,8 @@ float scaled_octave_noise_3d(  const float octaves,
                             const float hiBound,
                             const float x,
                             const float y,
-                            const float z);
+                            const float z,
+                            const float tolerance = 0.0f);
 float scaled_octave_noise_4d(  const float octaves,
                             const float persistence,
                             const float scale,
@@ -93,7 +106,8 @@ float scaled_octave_noise_4d(  const float octaves,
                             const float x,
                             const float y,
                             const float z,
-                            const float w);
+                            const float w,
+                            const float tolerance = 0.0f);
 
 // Scaled Raw Simplex noise
 // The result will be between the two parameters passed.
@@ -114,7 +128,12 @@ float scaled_raw_noise_4d( const float loBound,
                         const float w);
 
 void normalize(float* arr, int size);
-int simplexnoise(long seed, float* map, int width, int height, float roughness);
+namespace Platec { class ThreadPool; }
+
+// Fill the zero pixels of a map with tileable noise. Rows are spread over
+// the pool's threads if one is given. See octave_noise_4d for tolerance.
+int simplexnoise(long seed, float* map, int width, int height, float roughness,
+                 Platec::ThreadPool* pool = NULL, float tolerance = 0.0f);
 
 
 // Raw Simplex noise - a single noise value.
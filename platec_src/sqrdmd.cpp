@@ -26,10 +26,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdexcept>
+#include <stdint.h>
+#include <vector>
 #ifdef __MINGW32__ // this is to avoid a problem with the hypot function which is messed up by Python...
 #undef __STRICT_ANSI__
 #endif
 #include "simplerandom.hpp"
+#include "counterrandom.hpp"
+#include "threadpool.hpp"
 
 #include "sqrdmd.hpp"
 
@@ -225,3 +229,163 @@ int sqrdmd(long seed, float* map, int size, float rgh)
 	}
 	return (0);
 }
+
+/* Splits every interval of a periodic axis that's at least two pixels long
+ * at its midpoint. Points holds the start of every interval; the last one
+ * ends at period. Returns false if no interval could be split. */
+static bool split_axis(const vector<int>& points, int period, vector<int>& mids)
+{
+	bool split = false;
+	mids.resize(points.size());
+	for (size_t k = 0; k < points.size(); ++k)
+	{
+		const int end = k + 1 < points.size() ? points[k + 1] : period;
+		const int length = end - points[k];
+		mids[k] = length >= 2 ? points[k] + length / 2 : -1;
+		split |= mids[k] >= 0;
+	}
+	return split;
+}
+
+/* Adds the midpoints to the lattice points in order. */
+static void merge_axis(vector<int>& points, const vector<int>& mids)
+{
+	vector<int> merged;
+	merged.reserve(points.size() * 2);
+	for (size_t k = 0; k < points.size(); ++k)
+	{
+		merged.push_back(points[k]);
+		if (mids[k] >= 0)
+			merged.push_back(mids[k]);
+	}
+	points.swap(merged);
+}
+
+int sqrdmd_parallel(long seed, float* map, int width, int height, float rgh,
+                    Platec::ThreadPool* pool)
+{
+	if (width < 2 || height < 2) {
+		throw invalid_argument("Map should be at least 2x2");
+	}
+
+	const int period_x = width - 1, period_y = height - 1;
+	float slope = rgh;
+
+	/* Lattice of the current level. Points on the last column and row are
+	 * copies of those on the first, so they're not stored here. */
+	vector<int> xs(1, 0), ys(1, 0), mid_x, mid_y;
+
+	for (uint32_t level = 0; ; ++level)
+	{
+		const bool split_x = split_axis(xs, period_x, mid_x);
+		const bool split_y = split_axis(ys, period_y, mid_y);
+		if (!split_x && !split_y)
+			break;
+
+		/* Every level has its own sequence, indexed by the position. */
+		const CounterRandom random(seed, level);
+		const size_t nx = xs.size(), ny = ys.size();
+
+		/* Set a point that's still zero to the mean of its neighbours
+		 * plus a random displacement. */
+		auto displace = [&](int x, int y, float sum, int count)
+		{
+			sum = sum / count;
+			sum = sum + slope * (int32_t)random.at(((uint64_t)y << 32) | x);
+			if ((int)map[y * width + x] == 0)
+				map[y * width + x] = sum;
+		};
+		auto at = [&](int x, int y) { return map[y * width + x]; };
+
+		/* Centers of the cells that are split both ways ("diamond step").
+		 * They only read the corners, so rows are independent. */
+		auto diamonds = [&](size_t first, size_t last)
+		{
+			for (size_t ky = first; ky < last; ++ky)
+			{
+				if (mid_y[ky] < 0)
+					continue;
+				const int y0 = ys[ky], y1 = ky + 1 < ny ? ys[ky + 1] : period_y;
+				for (size_t kx = 0; kx < nx; ++kx)
+				{
+					if (mid_x[kx] < 0)
+						continue;
+					const int x0 = xs[kx], x1 = kx + 1 < nx ? xs[kx + 1] : period_x;
+					displace(mid_x[kx], mid_y[ky], at(x0, y0) + at(x1, y0) +
+					         at(x0, y1) + at(x1, y1), 4);
+				}
+			}
+		};
+
+		/* Midpoints of the cell edges ("square step"). Each one averages
+		 * the ends of its edge and the centers on either side of it that
+		 * exist, wrapping around the map. Row ky writes the midpoints on
+		 * its top edge and on its vertical edges, plus their copies in the
+		 * bottom row and right column. */
+		auto squares = [&](size_t first, size_t last)
+		{
+			for (size_t ky = first; ky < last; ++ky)
+			{
+				const int y0 = ys[ky], y1 = ky + 1 < ny ? ys[ky + 1] : period_y;
+				const size_t above = ky > 0 ? ky - 1 : ny - 1;
+
+				for (size_t kx = 0; kx < nx; ++kx)
+				{
+					const int mx = mid_x[kx];
+					if (mx < 0)
+						continue;
+					const int x0 = xs[kx], x1 = kx + 1 < nx ? xs[kx + 1] : period_x;
+					float sum = at(x0, y0) + at(x1, y0);
+					int count = 2;
+					if (mid_y[ky] >= 0) {
+						sum += at(mx, mid_y[ky]);
+						++count;
+					}
+					if (mid_y[above] >= 0) {
+						sum += at(mx, mid_y[above]);
+						++count;
+					}
+					displace(mx, y0, sum, count);
+					if (ky == 0) /* Copy top val into btm row. */
+						map[period_y * width + mx] = map[mx];
+				}
+
+				const int my = mid_y[ky];
+				if (my < 0)
+					continue;
+				for (size_t kx = 0; kx < nx; ++kx)
+				{
+					const size_t left = kx > 0 ? kx - 1 : nx - 1;
+					const int x0 = xs[kx];
+					float sum = at(x0, y0) + at(x0, y1);
+					int count = 2;
+					if (mid_x[kx] >= 0) {
+						sum += at(mid_x[kx], my);
+						++count;
+					}
+					if (mid_x[left] >= 0) {
+						sum += at(mid_x[left], my);
+						++count;
+					}
+					displace(x0, my, sum, count);
+				}
+				/* Copy left value into right column. */
+				map[my * width + period_x] = map[my * width];
+			}
+		};
+
+		if (pool) {
+			pool->parallelFor(0, ny, diamonds);
+			pool->parallelFor(0, ny, squares);
+		} else {
+			diamonds(0, ny);
+			squares(0, ny);
+		}
+
+		merge_axis(xs, mid_x);
+		merge_axis(ys, mid_y);
+		slope *= rgh; /* reduce amount of randomness for next round */
+	}
+
+	return (0);
+}
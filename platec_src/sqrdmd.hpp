@@ -24,6 +24,8 @@
 #ifndef SQRDMD_H
 #define SQRDMD_H
 
+namespace Platec { class ThreadPool; }
+
 /**
  * @brief Scales the values of the map between [0, 1[.
  *
@@ -48,4 +50,24 @@ void normalize(float* map, int size);
  */
 int sqrdmd(long seed, float* map, const int size, float rgh);
 
+/**
+ *  @brief Generates a tileable fractal height map of any size in parallel.
+ *
+ *  Works like sqrdmd() on a rectangular map: the last column and row are
+ *  copies of the first ones, so the map tiles with a period of
+ *  width - 1 by height - 1. On every level each interval between lattice
+ *  points along an axis that's at least two pixels long is split at its
+ *  middle, so sides need not be powers of two plus one.
+ *
+ *  The random displacement of each point depends only on the seed, the
+ *  point's coordinates and the level of detail, not on the order the points
+ *  are computed in. Every level is split into rows that are computed on
+ *  the pool's threads, and the result doesn't depend on the number of
+ *  threads. The map differs from sqrdmd()'s for the same seed.
+ *
+ *  @param	pool Threads to use, or NULL to compute on the calling thread.
+ */
+int sqrdmd_parallel(long seed, float* map, int width, int height, float rgh,
+                    Platec::ThreadPool* pool);
+
 #endif
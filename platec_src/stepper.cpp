@@ -0,0 +1,113 @@
+#include "stepper.hpp"
+#include "lithosphere.hpp"
+
+#include <utility>
+
+asyncStepper::asyncStepper(lithosphere& litho) :
+    _litho(litho),
+    _busy(false),
+    _queued(0),
+    _readyIsNew(false),
+    _stop(false)
+{
+    _worker = std::thread(&asyncStepper::workerMain, this);
+}
+
+asyncStepper::~asyncStepper() throw()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stop = true;
+    }
+    _queuedStep.notify_one();
+    _worker.join();
+}
+
+void asyncStepper::step(size_t max_queued)
+{
+    std::unique_lock<std::mutex> guard(_lock);
+    if (!_busy)
+    {
+        // Nothing runs until this call, so the live maps are stable.
+        take(_front);
+        _busy = true;
+    }
+
+    _finishedStep.wait(guard, [this, max_queued] {
+        return _queued < max_queued || _error; });
+    rethrowError();
+
+    if (_readyIsNew)
+    {
+        std::swap(_front, _ready);
+        _readyIsNew = false;
+    }
+    ++_queued;
+    guard.unlock();
+    _queuedStep.notify_one();
+}
+
+void asyncStepper::wait()
+{
+    std::unique_lock<std::mutex> guard(_lock);
+    _finishedStep.wait(guard, [this] { return _queued == 0; });
+    _busy = false;
+    _readyIsNew = false;
+    rethrowError();
+}
+
+void asyncStepper::take(snapshot& s) const
+{
+    const size_t area = _litho._worldDimension.getArea();
+    s.topography.assign(_litho.hmap.raw_data(), _litho.hmap.raw_data() + area);
+    s.plates.assign(_litho.imap, _litho.imap + area);
+    s.ages.assign(_litho.amap.raw_data(), _litho.amap.raw_data() + area);
+    s.plate_count = _litho.num_plates;
+}
+
+void asyncStepper::rethrowError()
+{
+    if (!_error)
+        return;
+
+    // The worker has dropped the queue, so the live maps are stable again.
+    std::exception_ptr error = _error;
+    _error = std::exception_ptr();
+    _busy = false;
+    _readyIsNew = false;
+    std::rethrow_exception(error);
+}
+
+void asyncStepper::workerMain()
+{
+    std::unique_lock<std::mutex> guard(_lock);
+    for (;;)
+    {
+        _queuedStep.wait(guard, [this] { return _stop || _queued > 0; });
+        if (_queued == 0)
+            return;
+
+        guard.unlock();
+        std::exception_ptr error;
+        try {
+            _litho.update();
+            take(_back);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        guard.lock();
+
+        if (error)
+        {
+            _error = error;
+            _queued = 0;
+        }
+        else
+        {
+            std::swap(_ready, _back);
+            _readyIsNew = true;
+            --_queued;
+        }
+        _finishedStep.notify_all();
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef STEPPER_HPP
+#define STEPPER_HPP
+
+#include <cstring> // For size_t.
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class lithosphere;
+
+/**
+ * Runs the steps of a system on a thread of its own.
+ *
+ * Steps are queued with step() and run in order while the caller goes on.
+ * Until the next wait(), the caller reads a snapshot of the maps instead of
+ * the live ones that the worker modifies. step() replaces the snapshot with
+ * the maps after the latest finished step, so the pointers into it stay
+ * valid until the caller's next call to step() or wait(). The worker
+ * prepares the next snapshot in a buffer of its own and hands it over in
+ * a third one, so neither side ever waits for the other to copy.
+ */
+class asyncStepper
+{
+  public:
+
+	explicit asyncStepper(lithosphere& litho);
+	~asyncStepper() throw(); ///< Finish the queued steps.
+
+	/// Queue a step, waiting while max_queued steps already are.
+	/// @exception Rethrows the exception of a step that failed.
+	void step(size_t max_queued);
+
+	/// Wait for the queued steps to finish.
+	/// @exception Rethrows the exception of a step that failed.
+	void wait();
+
+	/// True between a call to step() and the following wait().
+	bool isBusy() const throw() { return _busy; }
+
+	float* getTopography() throw() { return &_front.topography[0]; }
+	size_t* getPlatesMap() throw() { return &_front.plates[0]; }
+	const size_t* getAgemap() const throw() { return &_front.ages[0]; }
+	size_t getPlateCount() const throw() { return _front.plate_count; }
+
+  private:
+
+	class snapshot
+	{
+	  public:
+		std::vector<float> topography;
+		std::vector<size_t> plates;
+		std::vector<size_t> ages;
+		size_t plate_count;
+	};
+
+	asyncStepper(const asyncStepper&);
+	asyncStepper& operator=(const asyncStepper&);
+
+	void take(snapshot& s) const; ///< Copy the live maps.
+	void rethrowError(); ///< Throw a failed step's exception once.
+	void workerMain();
+
+	lithosphere& _litho;
+	snapshot _front; ///< Read by the caller.
+	snapshot _ready; ///< Latest finished step, unless taken already.
+	snapshot _back;  ///< Written by the worker.
+	bool _busy;      ///< Caller reads the snapshot. Only it uses this.
+
+	std::thread _worker;
+	std::mutex _lock;
+	std::condition_variable _queuedStep;   ///< A step has been queued.
+	std::condition_variable _finishedStep; ///< A step has finished.
+	size_t _queued;        ///< Steps queued or running.
+	bool _readyIsNew;      ///< _ready holds a step _front doesn't.
+	bool _stop;            ///< Exit once the queue is empty.
+	std::exception_ptr _error; ///< Exception of a failed step.
+};
+
+#endif
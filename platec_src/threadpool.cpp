@@ -0,0 +1,226 @@
+#include "threadpool.hpp"
+
+namespace Platec {
+
+// The pool and the queue index of the calling thread, if it's a worker.
+static thread_local ThreadPool* current_pool = 0;
+static thread_local size_t current_queue = 0;
+
+ThreadPool::ThreadPool(size_t num_workers) :
+    _worker_count(num_workers),
+    _queued(0),
+    _stop(false)
+{
+    if (_worker_count == 0)
+        _worker_count = std::thread::hardware_concurrency();
+    if (_worker_count == 0)
+        _worker_count = 1;
+
+    // The calling thread is one of the workers, so spawn one less.
+    const size_t num_threads = _worker_count - 1;
+    for (size_t i = 0; i <= num_threads; ++i)
+        _queues.push_back(new queue());
+
+    for (size_t i = 0; i < num_threads; ++i)
+        _threads.push_back(std::thread(&ThreadPool::workerMain, this, i));
+}
+
+ThreadPool::~ThreadPool() throw()
+{
+    {
+        std::lock_guard<std::mutex> guard(_sleep_lock);
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for (size_t i = 0; i < _threads.size(); ++i)
+        _threads[i].join();
+
+    for (size_t i = 0; i < _queues.size(); ++i)
+        delete _queues[i];
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    // Never destroyed: worker threads can't be joined safely while the
+    // process (or the Python interpreter) is shutting down.
+    static ThreadPool* pool = new ThreadPool(0);
+    return *pool;
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end,
+    const std::function<void(size_t, size_t)>& body, size_t grain)
+{
+    if (begin >= end)
+        return;
+
+    grain = grain > 0 ? grain : 1;
+    const size_t count = end - begin;
+
+    if (_worker_count == 1 || count <= grain)
+    {
+        body(begin, end);
+        return;
+    }
+
+    // A few chunks per worker even out the differences in their cost.
+    size_t num_chunks = count / grain;
+    num_chunks = num_chunks < 4 * _worker_count ? num_chunks : 4 * _worker_count;
+
+    TaskGroup group(*this);
+    for (size_t i = 0; i < num_chunks; ++i)
+    {
+        const size_t first = begin + count * i / num_chunks;
+        const size_t last = begin + count * (i + 1) / num_chunks;
+        group.run([&body, first, last]() { body(first, last); });
+    }
+    group.wait();
+}
+
+void ThreadPool::push(const task& t)
+{
+    // Workers keep their own tasks, outsiders share the last queue.
+    const size_t index = current_pool == this ? current_queue :
+        _queues.size() - 1;
+
+    {
+        std::lock_guard<std::mutex> guard(_queues[index]->lock);
+        _queues[index]->tasks.push_back(t);
+    }
+    ++_queued;
+
+    {
+        std::lock_guard<std::mutex> guard(_sleep_lock);
+    }
+    _wake.notify_one();
+}
+
+bool ThreadPool::pop(task& t)
+{
+    const size_t num_queues = _queues.size();
+    const bool is_worker = current_pool == this;
+    const size_t own = is_worker ? current_queue : num_queues - 1;
+
+    if (is_worker)
+    {
+        queue& q = *_queues[own];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.tasks.empty())
+        {
+            t = q.tasks.back();
+            q.tasks.pop_back();
+            --_queued;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of somebody else.
+    for (size_t i = 0; i < num_queues; ++i)
+    {
+        queue& q = *_queues[(own + 1 + i) % num_queues];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.tasks.empty())
+        {
+            t = q.tasks.front();
+            q.tasks.pop_front();
+            --_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::execute(task& t)
+{
+    std::exception_ptr error;
+    try {
+        t.func();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    t.group->finish(error);
+}
+
+bool ThreadPool::runOne()
+{
+    task t;
+    if (!pop(t))
+        return false;
+
+    execute(t);
+    return true;
+}
+
+void ThreadPool::workerMain(size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+
+    for (;;)
+    {
+        if (runOne())
+            continue;
+
+        std::unique_lock<std::mutex> guard(_sleep_lock);
+        while (!_stop && _queued == 0)
+            _wake.wait(guard);
+
+        if (_stop)
+            return;
+    }
+}
+
+TaskGroup::~TaskGroup() throw()
+{
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void TaskGroup::run(const std::function<void()>& func)
+{
+    if (_pool.getWorkerCount() == 1)
+    {
+        func();
+        return;
+    }
+
+    ++_pending;
+    _pool.push(ThreadPool::task(this, func));
+}
+
+void TaskGroup::wait()
+{
+    while (_pending > 0)
+    {
+        if (_pool.runOne())
+            continue;
+
+        std::unique_lock<std::mutex> guard(_lock);
+        while (_pending > 0)
+            _done.wait(guard);
+    }
+
+    // Synchronize with the last finish() before the group may be destroyed.
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_error)
+    {
+        std::exception_ptr error = _error;
+        _error = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+}
+
+void TaskGroup::finish(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (error && !_error)
+        _error = error;
+
+    if (--_pending == 0)
+        _done.notify_all();
+}
+
+}
@@ -0,0 +1,137 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <cstring> // For size_t.
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Platec {
+
+class TaskGroup;
+
+/**
+ * Small work-stealing thread pool.
+ *
+ * Every worker owns a task queue. Workers take tasks from the back of their
+ * own queue and steal from the front of the others' when they run dry.
+ * Threads waiting for a group of tasks to finish help executing them, so
+ * nested parallel loops never dead lock.
+ *
+ * A pool of one worker spawns no threads at all: every task is run on the
+ * calling thread at the moment it's submitted, i.e. in program order.
+ */
+class ThreadPool
+{
+  public:
+
+	/**
+	 * Create a pool of given size.
+	 *
+	 * @param num_workers Number of threads that execute tasks, calling
+	 *                    thread included. Zero selects one worker per
+	 *                    hardware thread.
+	 */
+	explicit ThreadPool(size_t num_workers);
+	~ThreadPool() throw();
+
+	size_t getWorkerCount() const throw() { return _worker_count; }
+
+	/// Process-wide pool with one worker per hardware thread.
+	static ThreadPool& shared();
+
+	/**
+	 * Call body(first, last) for consecutive subranges of [begin, end[.
+	 *
+	 * Returns after the whole range has been processed. If any call
+	 * throws, the first exception is rethrown to the caller. With a single
+	 * worker body is called exactly once with the entire range.
+	 *
+	 * @param grain Minimum number of items given to one call of body.
+	 */
+	void parallelFor(size_t begin, size_t end,
+	                 const std::function<void(size_t, size_t)>& body,
+	                 size_t grain = 1);
+
+  private:
+
+	friend class TaskGroup;
+
+	class task
+	{
+	  public:
+		task() : group(0) {}
+		task(TaskGroup* g, const std::function<void()>& f) :
+			group(g), func(f) {}
+
+		TaskGroup* group;
+		std::function<void()> func;
+	};
+
+	class queue
+	{
+	  public:
+		std::mutex lock;
+		std::deque<task> tasks;
+	};
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void push(const task& t);
+	bool pop(task& t);
+	void execute(task& t);
+	bool runOne();
+	void workerMain(size_t index);
+
+	size_t _worker_count;
+	std::vector<std::thread> _threads;
+	std::vector<queue*> _queues; ///< One per thread, last one for outsiders.
+	std::atomic<size_t> _queued; ///< Number of tasks waiting in queues.
+
+	std::mutex _sleep_lock;
+	std::condition_variable _wake;
+	bool _stop;
+};
+
+/**
+ * Set of tasks submitted to a pool that can be waited for together.
+ */
+class TaskGroup
+{
+  public:
+
+	explicit TaskGroup(ThreadPool& pool) : _pool(pool), _pending(0) {}
+	~TaskGroup() throw();
+
+	/// Queue a task. Single worker pools run it immediately.
+	void run(const std::function<void()>& func);
+
+	/// Help executing tasks until all of this group's tasks are done.
+	/// Rethrows the first exception thrown by any of the tasks.
+	void wait();
+
+  private:
+
+	friend class ThreadPool;
+
+	TaskGroup(const TaskGroup&);
+	TaskGroup& operator=(const TaskGroup&);
+
+	void finish(std::exception_ptr error);
+
+	ThreadPool& _pool;
+	std::atomic<size_t> _pending;
+	std::mutex _lock;
+	std::condition_variable _done;
+	std::exception_ptr _error;
+};
+
+}
+
+#endif
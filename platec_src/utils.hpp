@@ -5,6 +5,7 @@
 
 #if _WIN32 || _WIN64
 #include <Windows.h>
+typedef UINT16 uint16_t;
 typedef UINT32 uint32_t;
 typedef INT32 int32_t;
 #else
@@ -1,6 +1,11 @@
+import sys
 from setuptools import setup, Extension, Command
 
-extra_compile_args = "-std=c++11"
+extra_compile_args = ["-std=c++11"]
+extra_link_args = []
+if sys.platform != "win32":
+    extra_compile_args.append("-pthread")
+    extra_link_args.append("-pthread")
 
 pyplatec = Extension('platec',                    
                     sources = [
@@ -12,11 +17,21 @@ pyplatec = Extension('platec',
                         'platec_src/rectangle.cpp',
                         'platec_src/simplexnoise.cpp',
                         'platec_src/simplerandom.cpp',
+                        'platec_src/counterrandom.cpp',
                         'platec_src/sqrdmd.cpp',
                         'platec_src/utils.cpp',
-                        'platec_src/noise.cpp'],
+                        'platec_src/noise.cpp',
+                        'platec_src/simd.cpp',
+                        'platec_src/buoyancy.cpp',
+                        'platec_src/threadpool.cpp',
+                        'platec_src/batch.cpp',
+                        'platec_src/checkpoint.cpp',
+                        'platec_src/recorder.cpp',
+                        'platec_src/stepper.cpp',
+                        'platec_src/publisher.cpp'],
                      language='c++',
-                     extra_compile_args=[extra_compile_args],
+                     extra_compile_args=extra_compile_args,
+                     extra_link_args=extra_link_args,
                     )
 
 setup (name = 'PyPlatec',